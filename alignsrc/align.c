@@ -36,6 +36,13 @@ void allocate_table (CELL ***table, int cols, int rows)
 }
 
 
+long table_bytes (int cols, int rows)
+// Return the number of bytes allocate_table holds for an x-cols x y-rows table.
+{
+	return (long) rows * sizeof (CELL*) + (long) rows * cols * sizeof (CELL);
+}
+
+
 void free_table (CELL ***table, int cols, int rows)
 // Free the memory allocated to an x-cols x y-rows 2D-array.
 {
@@ -114,24 +121,6 @@ void init_table (CELL ***table, int ilo, int jlo, int cols, int rows, char align
 		(*table)[ilo][j].del = -1 * INF;
 		(*table)[ilo][j].score = 0;
 	}
-	for (i = ilo + 1; i < rows; ++i) {
-		(*table)[i][cols].sub = -1 * INF;
-		(*table)[i][cols].ins = -1 * INF;
-		if (penalty)		// Local does not init with a penalty
-			(*table)[i][cols].del = HGAP + i * penalty;
-		else 
-			(*table)[i][cols].del = 0;
-		(*table)[i][cols].score = 0;
-	}
-	for (j = jlo + 1; j < cols; ++j) {
-		(*table)[rows][j].sub = -1 * INF;
-		if (penalty)		// Local does not init with a penalty
-			(*table)[rows][j].ins = HGAP + j * penalty;
-		else
-			(*table)[rows][j].ins = 0;
-		(*table)[rows][j].del = -1 * INF;
-		(*table)[rows][j].score = 0;
-	}
 }
 
 
@@ -162,6 +151,7 @@ int calculate_table_loc (CELL ***table, int *maxi, int *maxj, char *s1, char *s2
 	double elapsed;
 	CELL *curr, *up, *diag, *left;
 
+	*maxi = ilo; *maxj = jlo;
 	for (i = ilo + 1; i < ihi; ++i) {
 		for (j = jlo + 1; j < jhi; ++j) {
             curr = &((*table)[i][j]); up = &((*table)[i-1][j]);
@@ -233,8 +223,10 @@ int traceback_loc (int *match, int *mismatch, int *gap, int *hgap,
 }
 
 
-int align_loc (char *s1, int s1len, char *s2, int *matchalign, CELL ***table)
-// Calculate the optimal local alignment for two strings s1 and s2.
+int align_loc_ref (char *s1, int s1len, char *s2, int *matchalign, CELL ***table, WORK *work)
+// Calculate the optimal local alignment for two strings s1 and s2 on a table
+// of CELL rows.  This is the reference the compact kernel is checked against.
+// Record the work done in work, if given.
 {
 	int i, ilo, jlo, ihi, jhi, n, m, opt_score, maxi, maxj, mini, minj;
 	int match, mismatch, gap, hgap;
@@ -260,6 +252,11 @@ int align_loc (char *s1, int s1len, char *s2, int *matchalign, CELL ***table)
 		matchalign[0] = alignlen;
 		matchalign[1] = match;
 
+		if (work) {
+			work -> cells = (long) m * n;
+			work -> tracesteps = match + mismatch + gap;	// One per step.
+		}
+
 		return opt_score;
 	}
 	printf ("Cannot align null string\n");
@@ -267,6 +264,523 @@ int align_loc (char *s1, int s1len, char *s2, int *matchalign, CELL ***table)
 }
 
 
+// ====================================================================
+// Compact kernel
+// ====================================================================
+
+// The kernel is instantiated for each scoring scheme below, with the scores
+// as literals, and once more reading the global parameters for any other
+// scheme.  align_loc dispatches on the parameters loaded at run time.
+
+// Generic: any scoring parameters.
+#define SCHEME_FN(x) x##_generic
+#define K_MATCH MATCH
+#define K_MISMATCH MISMATCH
+#define K_HGAP HGAP
+#define K_GAP GAP
+#include "align_kernel.h"
+
+// INPUTS/parameters.config as shipped.
+#define SCHEME_FN(x) x##_default
+#define K_MATCH 1
+#define K_MISMATCH (-2)
+#define K_HGAP (-5)
+#define K_GAP (-1)
+#include "align_kernel.h"
+
+// BWA-style: mismatch 4, gap open 6, gap extend 1.
+#define SCHEME_FN(x) x##_bwa
+#define K_MATCH 1
+#define K_MISMATCH (-4)
+#define K_HGAP (-6)
+#define K_GAP (-1)
+#include "align_kernel.h"
+
+// BLASTN-style: reward 2, penalty 3, gap open 5, gap extend 2.
+#define SCHEME_FN(x) x##_blastn
+#define K_MATCH 2
+#define K_MISMATCH (-3)
+#define K_HGAP (-5)
+#define K_GAP (-2)
+#include "align_kernel.h"
+
+
+// Kernel functions for one scoring scheme.
+typedef struct align_scheme {
+	int match, mismatch, hgap, gap;
+	int (*fill_16) (DPTABLE*, char*, int, int*, int*);
+	int (*traceback_16) (DPTABLE*, int, int, char*, int*, int*, int*, int*);
+	int (*fill_32) (DPTABLE*, char*, int, int*, int*);
+	int (*traceback_32) (DPTABLE*, int, int, char*, int*, int*, int*, int*);
+} SCHEME;
+
+static SCHEME schemes[] = {
+	{ 1, -2, -5, -1, fill_16_default, traceback_16_default, fill_32_default, traceback_32_default },
+	{ 1, -4, -6, -1, fill_16_bwa, traceback_16_bwa, fill_32_bwa, traceback_32_bwa },
+	{ 2, -3, -5, -2, fill_16_blastn, traceback_16_blastn, fill_32_blastn, traceback_32_blastn },
+};
+
+static SCHEME generic = { 0, 0, 0, 0, fill_16_generic, traceback_16_generic,
+							fill_32_generic, traceback_32_generic };
+
+
+SCHEME *select_scheme ()
+// Return the kernels specialized for the loaded scoring parameters, or the
+// generic ones if there are none.
+{
+	size_t k;
+	for (k = 0; k < sizeof (schemes) / sizeof (SCHEME); ++k) {
+		if (schemes[k].match == MATCH && schemes[k].mismatch == MISMATCH
+				&& schemes[k].hgap == HGAP && schemes[k].gap == GAP) {
+			return &schemes[k];
+		}
+	}
+	return &generic;
+}
+
+
+#define CACHE_LINE	64
+
+
+DPTABLE *new_dptable ()
+// Allocate an empty table; it is sized by each call to align_loc.
+{
+	DPTABLE *dp = (DPTABLE*) calloc (1, sizeof (DPTABLE));
+	if (!dp) {
+		perror ("Unable to allocate alignment table");
+		exit (1);
+	}
+	return dp;
+}
+
+
+void free_dptable (DPTABLE *dp)
+// Free a table and its blocks.
+{
+	free (dp -> mem);
+	free (dp -> profile);
+	free (dp -> band);
+	free (dp);
+}
+
+
+long dptable_bytes (DPTABLE *dp)
+// Return the number of bytes the table holds.
+{
+	return sizeof (DPTABLE) + dp -> bytes + dp -> profbytes + dp -> bandbytes;
+}
+
+
+int lanes16_fit (int m, int n)
+// Return 1 if every value of an m x n table fits in 16 bits.  With no
+// positive gap scores, a cell can only exceed its diagonal neighbour by the
+// best substitution score, and a path has at most min(m, n) diagonal steps.
+{
+	int step = max (max (MATCH, MISMATCH), 0);
+	if (GAP > 0 || HGAP + GAP > 0 || INF > 32767) return 0;
+	if (GAP < -16384 || HGAP + GAP < -16384 || min (MATCH, MISMATCH) < -16384) return 0;
+	return (long) step * min (m, n) <= 16383;
+}
+
+
+void layout_dptable (DPTABLE *dp, int rows, int cols, int lanesize)
+// Lay the planes out for a rows x cols table, growing the block if needed.
+// Rows are padded to whole cache lines so each starts on one.
+{
+	long plane, row, need;
+	dp -> lanesize = lanesize;
+	dp -> stride = (cols * lanesize + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE / lanesize;
+	row = (long) dp -> stride * lanesize;
+	plane = row * rows;
+	need = 3 * plane + 2 * row;
+	if (need > dp -> bytes) {
+		free (dp -> mem);
+		if (need < dp -> bytes * 3 / 2) need = dp -> bytes * 3 / 2;
+		if (posix_memalign ((void**) &dp -> mem, CACHE_LINE, need)) {
+			perror ("Unable to allocate alignment table");
+			exit (1);
+		}
+		dp -> bytes = need;
+	}
+	dp -> sub = dp -> mem;
+	dp -> ins = dp -> mem + plane;
+	dp -> del = dp -> mem + 2 * plane;
+	dp -> score = dp -> mem + 3 * plane;
+}
+
+
+void set_query (DPTABLE *dp, char *s2)
+// Make s2 the read the table aligns windows against.  The profile's rows
+// are assigned here and filled on first use, once the lane size is known.
+// s2 must stay unchanged until the next call.
+{
+	int r, m = strlen (s2);
+
+	dp -> query = s2;
+	dp -> querylen = m;
+	dp -> proflane = 0;
+	memset (dp -> code, 0, sizeof (dp -> code));
+	dp -> profrows = 1;
+	for (r = 0; r < m; ++r) {
+		if (!dp -> code[(unsigned char) s2[r]]) {
+			dp -> code[(unsigned char) s2[r]] = dp -> profrows++;
+		}
+	}
+}
+
+
+void fill_profile (DPTABLE *dp, int lanesize)
+// Fill the query profile with lanes of the given size, growing its block if
+// needed.  Row 0 is all mismatches.
+{
+	long need;
+	int r, c, row, score;
+	char *s2 = dp -> query;
+	int m = dp -> querylen;
+
+	dp -> profstride = (m * lanesize + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE / lanesize;
+	if (!dp -> profstride) dp -> profstride = CACHE_LINE / lanesize;
+	need = (long) dp -> profrows * dp -> profstride * lanesize;
+	if (need > dp -> profbytes) {
+		free (dp -> profile);
+		if (posix_memalign ((void**) &dp -> profile, CACHE_LINE, need)) {
+			perror ("Unable to allocate query profile");
+			exit (1);
+		}
+		dp -> profbytes = need;
+	}
+	for (c = 0; c < 256; ++c) {
+		if (c && !dp -> code[c]) continue;
+		row = dp -> code[c] * dp -> profstride;
+		for (r = 0; r < m; ++r) {
+			score = (row && (unsigned char) s2[r] == c)? MATCH : MISMATCH;
+			if (lanesize == sizeof (short)) {
+				((short*) dp -> profile)[row + r] = score;
+			} else {
+				((int*) dp -> profile)[row + r] = score;
+			}
+		}
+	}
+	dp -> proflane = lanesize;
+}
+
+
+int align_query (char *s1, int s1len, int *matchalign, int *span, DPTABLE *dp, WORK *work)
+// Calculate the optimal local alignment of the table's query against the
+// window s1, with the same result as align_loc_ref, on a compact table sized
+// for this call.  Record the window positions [start, end) the alignment
+// covers in span and the work done in work, if given.
+{
+	int n, m, lanesize, opt_score, maxi, maxj, minj;
+	int match, mismatch, gap, hgap;
+	SCHEME *scheme;
+	match = mismatch = gap = hgap = 0;
+
+	// Do not try to align null strings.
+	if (!s1 || !dp -> query) {
+		printf ("Cannot align null string\n");
+		exit (1);
+	}
+	n = s1len, m = dp -> querylen;
+
+	scheme = (dp -> generic)? &generic : select_scheme ();
+	lanesize = (lanes16_fit (m, n))? sizeof (short) : sizeof (int);
+	if (dp -> proflane != lanesize) fill_profile (dp, lanesize);
+	layout_dptable (dp, n + 1, m + 1, lanesize);
+	if (lanesize == sizeof (short)) {
+		opt_score = scheme -> fill_16 (dp, s1, n, &maxi, &maxj);
+		minj = scheme -> traceback_16 (dp, maxi, maxj, s1, &match, &mismatch, &gap, &hgap);
+	} else {
+		opt_score = scheme -> fill_32 (dp, s1, n, &maxi, &maxj);
+		minj = scheme -> traceback_32 (dp, maxi, maxj, s1, &match, &mismatch, &gap, &hgap);
+	}
+
+	matchalign[0] = match + mismatch + gap + hgap;
+	matchalign[1] = match;
+	if (span) {
+		span[0] = minj;
+		span[1] = maxj;
+	}
+	if (work) {
+		work -> cells = (long) m * n;
+		work -> tracesteps = match + mismatch + gap;	// One per step.
+	}
+	return opt_score;
+}
+
+
+int align_loc (char *s1, int s1len, char *s2, int *matchalign, DPTABLE *dp, WORK *work)
+// Calculate the optimal local alignment for two strings s1 and s2, with the
+// same result as align_loc_ref.  Record the work done in work, if given.
+{
+	if (!s2) {
+		printf ("Cannot align null string\n");
+		exit (1);
+	}
+	set_query (dp, s2);
+	return align_query (s1, s1len, matchalign, NULL, dp, work);
+}
+
+
+// ====================================================================
+// Ungapped extension
+// ====================================================================
+
+
+int extend_ungapped (char *read, int readlen, char *ref, int reflo, int refhi,
+						int diag, int seed, int *matchalign, int *span)
+// Extend an ungapped alignment of the read against ref, with read[0] over
+// ref[diag], rightward from read position seed and leftward from seed - 1.
+// Each direction stops at the end of the read, at the bounds [reflo, refhi)
+// of ref, or once its score falls XDROP below the best it has reached, and
+// keeps the extent with the best score.  Record the aligned length and
+// matches in matchalign as align_loc does and the read positions [start, end)
+// aligned in span, and return the score.
+{
+	int r, score, best, matches, bestmatches, right, left, rightscore;
+
+	// Rightward, over the seed and beyond.
+	score = best = matches = bestmatches = 0;
+	right = seed;
+	for (r = seed; r < readlen && diag + r < refhi; ++r) {
+		if (read[r] == ref[diag + r]) {
+			score += MATCH; ++matches;
+		} else {
+			score += MISMATCH;
+		}
+		if (score > best) {
+			best = score; bestmatches = matches; right = r + 1;
+		} else if (score < best - XDROP) {
+			break;
+		}
+	}
+	matchalign[0] = right - seed;
+	matchalign[1] = bestmatches;
+	rightscore = best;
+
+	// Leftward from just before the seed.
+	score = best = matches = bestmatches = 0;
+	left = seed;
+	for (r = seed - 1; r >= 0 && diag + r >= reflo; --r) {
+		if (read[r] == ref[diag + r]) {
+			score += MATCH; ++matches;
+		} else {
+			score += MISMATCH;
+		}
+		if (score > best) {
+			best = score; bestmatches = matches; left = r;
+		} else if (score < best - XDROP) {
+			break;
+		}
+	}
+	matchalign[0] += seed - left;
+	matchalign[1] += bestmatches;
+	span[0] = left;
+	span[1] = left + matchalign[0];
+	return rightscore + best;
+}
+
+
+// ====================================================================
+// Banded alignment
+// ====================================================================
+
+#define BAND_NONE	(-(1 << 28))	// Score of a cell no path reaches.
+
+
+void band_extend (BANDPATH *to, BANDPATH *from, int score, int match)
+// Make to the path from extended by one column of the given score and
+// matches, if that scores higher than to already does.
+{
+	if (from -> score > BAND_NONE && from -> score + score > to -> score) {
+		to -> score = from -> score + score;
+		to -> match = from -> match + match;
+		to -> len = from -> len + 1;
+	}
+}
+
+
+int band_center (int i, int s1len, int s2len, int extend)
+// Column the band of row i is centred on: the diagonal from the top-left
+// corner when extending, the line between opposite corners when not.
+{
+	if (extend) return i;
+	return (s2len)? (int) ((long) i * s1len / s2len) : 0;
+}
+
+
+int align_banded (char *s1, int s1len, char *s2, int s2len, int band, int extend,
+					int *matchalign, int *reach, DPTABLE *dp, WORK *work)
+// Align s2 (rows) against s1 (columns), with affine gaps, over the cells
+// within band columns either side of the band's centre line.  Globally, the
+// alignment runs corner to corner and the centre line joins the corners, so
+// the band follows pieces of unequal length.  When extending, it starts at
+// the top-left corner, follows the main diagonal, ends wherever it scores
+// best (possibly before aligning anything), and stops once a whole row falls
+// XDROP below that.  Only two rows of the band are kept, so memory is linear
+// in the band and time in the band times s2len.  Record the aligned length
+// and matches in matchalign as align_loc does, the rows and columns the
+// alignment spans in reach when given, and return its score.
+{
+	BANDCELL *prev, *curr, *cell, *swap;
+	BANDPATH best = { 0, 0, 0 };
+	int i, j, lo, hi, plo, phi, width, besti = 0, bestj = 0, rowbest;
+	long cells = 0;
+
+	// Globally, consecutive rows' bands must overlap for a path to get through.
+	if (!extend) {
+		if (!s2len) band = max (band, s1len);
+		else band = max (band, s1len / s2len + 1);
+	}
+	width = 2 * band + 1;
+	if (dp -> bandbytes < 2L * width * (long) sizeof (BANDCELL)) {
+		free (dp -> band);
+		dp -> bandbytes = 2L * width * sizeof (BANDCELL);
+		dp -> band = malloc (dp -> bandbytes);
+		if (!dp -> band) {
+			perror ("Unable to allocate band");
+			exit (1);
+		}
+	}
+	prev = (BANDCELL*) dp -> band;
+	curr = prev + width;
+
+	// Row 0: the empty path, then gaps along the row.
+	lo = 0;
+	hi = min (s1len, band);
+	for (j = lo; j <= hi; ++j) {
+		cell = &curr[j];
+		cell -> best.score = cell -> ins.score = cell -> del.score = BAND_NONE;
+		if (j == 0) {
+			cell -> best.score = cell -> best.match = cell -> best.len = 0;
+		} else {
+			band_extend (&cell -> ins, &curr[j - 1].ins, GAP, 0);
+			band_extend (&cell -> ins, &curr[j - 1].best, HGAP + GAP, 0);
+			cell -> best = cell -> ins;
+		}
+		++cells;
+	}
+
+	for (i = 1; i <= s2len; ++i) {
+		swap = prev; prev = curr; curr = swap;
+		plo = lo; phi = hi;
+		lo = max (0, band_center (i, s1len, s2len, extend) - band);
+		hi = min (s1len, band_center (i, s1len, s2len, extend) + band);
+		if (lo > hi) break;
+		rowbest = BAND_NONE;
+		for (j = lo; j <= hi; ++j) {
+			cell = &curr[j - lo];
+			cell -> best.score = cell -> ins.score = cell -> del.score = BAND_NONE;
+			if (j >= plo && j <= phi) {
+				band_extend (&cell -> del, &prev[j - plo].del, GAP, 0);
+				band_extend (&cell -> del, &prev[j - plo].best, HGAP + GAP, 0);
+			}
+			if (j > lo) {
+				band_extend (&cell -> ins, &curr[j - 1 - lo].ins, GAP, 0);
+				band_extend (&cell -> ins, &curr[j - 1 - lo].best, HGAP + GAP, 0);
+			}
+			if (j > plo && j - 1 <= phi) {
+				band_extend (&cell -> best, &prev[j - 1 - plo].best, sub (s1[j-1], s2[i-1]),
+								s1[j-1] == s2[i-1]);
+			}
+			if (cell -> ins.score > cell -> best.score) cell -> best = cell -> ins;
+			if (cell -> del.score > cell -> best.score) cell -> best = cell -> del;
+			if (cell -> best.score > rowbest) rowbest = cell -> best.score;
+			if (extend && cell -> best.score > best.score) {
+				best = cell -> best;
+				besti = i; bestj = j;
+			}
+			++cells;
+		}
+		if (extend && rowbest < best.score - XDROP) break;
+	}
+
+	if (!extend) {
+		// The band of the last row always holds the bottom-right corner.
+		best = curr[s1len - lo].best;
+		besti = s2len; bestj = s1len;
+	}
+	matchalign[0] = best.len;
+	matchalign[1] = best.match;
+	if (reach) {
+		reach[0] = besti;
+		reach[1] = bestj;
+	}
+	work -> cells = cells;
+	work -> tracesteps = 0;
+	return best.score;
+}
+
+
+// ====================================================================
+// Kernel table
+// ====================================================================
+
+
+void *ref_alloc (int cols, int rows)
+// Allocate a table for the reference kernel.
+{
+	CELL **table;
+	allocate_table (&table, cols, rows);
+	return table;
+}
+
+
+int ref_align (char *s1, int s1len, char *s2, int *matchalign, void *table, WORK *work)
+// Align with the reference kernel.
+{
+	CELL **cells = (CELL**) table;
+	return align_loc_ref (s1, s1len, s2, matchalign, &cells, work);
+}
+
+
+void ref_release (void *table, int cols, int rows)
+// Free a table allocated for the reference kernel.
+{
+	CELL **cells = (CELL**) table;
+	free_table (&cells, cols, rows);
+}
+
+
+void *compact_alloc (int cols, int rows)
+// Allocate a table for the compact kernel; it sizes itself per call.
+{
+	return new_dptable ();
+}
+
+
+void *generic_alloc (int cols, int rows)
+// Allocate a table for the compact kernel that never uses a specialized scheme.
+{
+	DPTABLE *dp = new_dptable ();
+	dp -> generic = 1;
+	return dp;
+}
+
+
+int compact_align (char *s1, int s1len, char *s2, int *matchalign, void *table, WORK *work)
+// Align with the compact kernel.
+{
+	return align_loc (s1, s1len, s2, matchalign, (DPTABLE*) table, work);
+}
+
+
+void compact_release (void *table, int cols, int rows)
+// Free a table allocated for the compact kernel.
+{
+	free_dptable ((DPTABLE*) table);
+}
+
+
+KERNEL align_kernels[] = {
+	{ "reference", ref_alloc, ref_align, ref_release },
+	{ "compact", compact_alloc, compact_align, compact_release },
+	{ "compact-generic", generic_alloc, compact_align, compact_release },
+};
+
+int num_align_kernels = sizeof (align_kernels) / sizeof (KERNEL);
+
+
 int bf_align (char *s1, char *s2) {
 	int i, j, s1len, s2len;
 	int jsave, isave, match, max;
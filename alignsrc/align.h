@@ -16,6 +16,7 @@
 #define S 0					// Substitution
 #define I 1 				// Insertion
 #define D 2 				// Deletion
+#define XDROP 20			// Score drop that ends an ungapped extension.
 
 extern int MATCH, MISMATCH, HGAP, GAP;
 
@@ -27,6 +28,73 @@ typedef struct DP_cell {
 	int score;
 } CELL;
 
+// Compact dynamic programming table.  The sub, ins and del values of each
+// cell are kept in separate planes within one cache-aligned block, laid out
+// for the read and window of each call, along with two rows of scores.  Lanes
+// are 16 bits wide when the scoring parameters and lengths allow, 32 if not.
+// The block only grows, so a table is cheap to reuse across calls.
+//
+// The table also holds the query profile of the read being aligned: a row
+// of substitution scores along the read for each distinct character of the
+// read, plus row 0 for characters the read does not contain.  It is built
+// once per read by set_query and reused for every window.
+typedef struct dp_table {
+	char *mem;				// Cache-aligned block holding the planes.
+	long bytes;				// Size of the block.
+	void *sub;				// Plane of substitution scores.
+	void *ins;				// Plane of insertion scores.
+	void *del;				// Plane of deletion scores.
+	void *score;			// Two rows of cell scores.
+	int stride;				// Lanes per row of each plane for the current call.
+	int lanesize;			// Bytes per lane for the current call.
+	int generic;			// Always use the generic kernel, for benchmarking.
+	char *query;			// Read the profile is for; not owned.
+	int querylen;			// Length of the read.
+	unsigned char code[256];	// Profile row of each character.
+	int profrows;			// Number of profile rows.
+	char *profile;			// Cache-aligned block holding the profile.
+	long profbytes;			// Size of the profile block.
+	int profstride;			// Lanes per profile row.
+	int proflane;			// Lane size the profile holds, 0 if not yet filled.
+	void *band;				// Two rows of cells for align_banded.
+	long bandbytes;			// Size of the band rows.
+} DPTABLE;
+
+// Best path into one cell of a banded alignment, with what it holds.
+typedef struct band_path {
+	int score;				// Score of the path.
+	int match;				// Matching columns along it.
+	int len;				// Columns along it.
+} BANDPATH;
+
+// Cell of a banded alignment: the best path into it, and the best ending
+// in a gap along the row (insertion) or down the column (deletion).
+typedef struct band_cell {
+	BANDPATH best;
+	BANDPATH ins;
+	BANDPATH del;
+} BANDCELL;
+
+// Work done by one alignment, for instrumentation.
+typedef struct align_work {
+	long cells;				// Dynamic programming cells computed.
+	long tracesteps;		// Traceback steps taken.
+} WORK;
+
+// An alignment kernel.  Each kernel owns its table layout: alloc returns a
+// table for alignments of up to cols-1 columns and rows-1 rows, and align
+// behaves as align_loc does on that table.  The first kernel in
+// align_kernels is the reference the others must agree with.
+typedef struct align_kernel {
+	const char *name;
+	void *(*alloc) (int, int);
+	int (*align) (char*, int, char*, int*, void*, WORK*);
+	void (*release) (void*, int, int);
+} KERNEL;
+
+extern KERNEL align_kernels[];
+extern int num_align_kernels;
+
 // Structure to store data about a particular alignment.
 typedef struct report_q {
 	struct report_q *next;	// For linking in a list.
@@ -49,7 +117,28 @@ typedef struct report_q {
 
 // ============================================================================
 
-int align_loc (char*,int,char*,int*,CELL***);
+// Reference kernel, on a table of CELL rows.
+void allocate_table (CELL***, int, int);
+void free_table (CELL***, int, int);
+long table_bytes (int, int);
+int align_loc_ref (char*,int,char*,int*,CELL***,WORK*);
+
+// Compact kernel, used for mapping.  set_query prepares a table for aligning
+// one read against any number of windows with align_query; align_loc does
+// both for a single pair.
+DPTABLE *new_dptable ();
+void free_dptable (DPTABLE*);
+long dptable_bytes (DPTABLE*);
+void set_query (DPTABLE*, char*);
+int align_query (char*,int,int*,int*,DPTABLE*,WORK*);
+int align_loc (char*,int,char*,int*,DPTABLE*,WORK*);
+
+// Ungapped X-drop extension of a read along one diagonal of a reference.
+int extend_ungapped (char*,int,char*,int,int,int,int,int*,int*);
+
+// Global alignment, or X-drop extension, of two pieces within a band of
+// diagonals, in memory linear in the band.
+int align_banded (char*,int,char*,int,int,int,int*,int*,DPTABLE*,WORK*);
 
 
 
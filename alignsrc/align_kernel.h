@@ -0,0 +1,211 @@
+// ============================================================================
+// align_kernel.h holds the body of the compact local alignment kernel.  It is
+// not a public header: align.c includes it once per scoring scheme, defining
+//
+//     SCHEME_FN(x)    the name to give function x for this scheme
+//     K_MATCH, K_MISMATCH, K_HGAP, K_GAP
+//                     the scheme's scores: literals in the specialized
+//                     instantiations, so the compiler can fold them, or the
+//                     global parameters in the generic one
+//
+// beforehand.  Each inclusion instantiates the kernel for 16- and 32-bit
+// lanes, as fill_16_<scheme>, fill_32_<scheme>, and so on, then clears the
+// scheme's definitions.  Arithmetic is done in int and only stored narrowed,
+// so the lane type only needs to hold the values a table can reach; see
+// lanes16_fit in align.c.
+//
+// The kernels compute exactly what calculate_table_loc and traceback_loc
+// compute on a CELL table, including the -INF boundary values, so that
+// every kernel agrees with the reference.
+// ============================================================================
+
+
+#ifndef LANE
+
+#define LANE short
+#define KERNEL_FN(x) SCHEME_FN(x##_16)
+#include "align_kernel.h"
+#undef LANE
+#undef KERNEL_FN
+
+#define LANE int
+#define KERNEL_FN(x) SCHEME_FN(x##_32)
+#include "align_kernel.h"
+#undef LANE
+#undef KERNEL_FN
+
+#undef SCHEME_FN
+#undef K_MATCH
+#undef K_MISMATCH
+#undef K_HGAP
+#undef K_GAP
+
+#else
+
+
+// The table is stored transposed: row w holds window position w and column
+// r read position r, so that the inner loops run along the read and take
+// their substitution scores straight from the query profile row of the
+// window character.  Cells are still named (i, j) = (read, window) as in the
+// reference, and sub, ins and del keep its meaning: ins comes from the
+// previous window position and del from the previous read position.
+
+
+static void KERNEL_FN(row_sub_ins) (LANE *restrict sr, LANE *restrict ir, LANE *restrict dr,
+									const LANE *restrict su, const LANE *restrict iu,
+									const LANE *restrict du, const LANE *restrict ps,
+									const LANE *restrict prof, int m)
+// Pass 1: fill sub and ins from the previous window row, then leave in dr
+// each cell's best way of opening a deletion from the previous read position.
+{
+	int r, s;
+	for (r = 1; r <= m; ++r) {
+		s = ps[r-1] + prof[r-1];
+		sr[r] = max (s, 0);
+		ir[r] = max4 (iu[r] + K_GAP, su[r] + K_HGAP + K_GAP, du[r] + K_HGAP + K_GAP, 0);
+	}
+	for (r = 1; r <= m; ++r) {
+		dr[r] = max (sr[r-1], ir[r-1]) + K_HGAP + K_GAP;
+	}
+}
+
+
+static int KERNEL_FN(row_scores) (LANE *restrict cs, const LANE *restrict sr,
+									const LANE *restrict ir, const LANE *restrict dr, int m)
+// Pass 3: fill the row's cell scores and return the best of them.
+{
+	int r, sc, rowmax = 0;
+	for (r = 1; r <= m; ++r) {
+		sc = max4 (sr[r], ir[r], dr[r], 0);
+		cs[r] = sc;
+		rowmax = max (rowmax, sc);
+	}
+	return rowmax;
+}
+
+
+static int KERNEL_FN(fill) (DPTABLE *dp, char *s1, int n, int *maxi, int *maxj)
+// Fill the table for the query against the window s1 of length n and return
+// the best local score, recording where it lies.  Only the del recurrence
+// runs along a row, so each row is filled in three passes and only the
+// second has a loop-carried dependency:
+//	1.	sub and ins, which depend on the previous row, and each cell's best
+//		way of opening a deletion from its left neighbour.
+//	2.	del, carried along the row in a register.
+//	3.	cell scores and the row's best.
+// Passes 1 and 3 can be vectorized.
+{
+	LANE *subp = (LANE*) dp -> sub, *insp = (LANE*) dp -> ins, *delp = (LANE*) dp -> del;
+	LANE *prevscore = (LANE*) dp -> score, *currscore = prevscore + dp -> stride, *swap;
+	LANE *prof = (LANE*) dp -> profile;
+	LANE *sr, *ir, *dr;
+	int stride = dp -> stride, m = dp -> querylen;
+	int w, r, de, rowmax, maxm = 0;
+
+	// Row 0 and column 0 hold the boundary values init_table gives column 0
+	// and row 0 of the reference table.
+	subp[0] = insp[0] = delp[0] = prevscore[0] = 0;
+	for (r = 1; r <= m; ++r) {
+		subp[r] = -1 * INF;
+		insp[r] = -1 * INF;
+		delp[r] = 0;
+		prevscore[r] = 0;
+	}
+	*maxi = *maxj = 0;
+
+	for (w = 1; w <= n; ++w) {
+		sr = subp + w * stride; ir = insp + w * stride; dr = delp + w * stride;
+		sr[0] = -1 * INF;
+		ir[0] = 0;
+		dr[0] = -1 * INF;
+		currscore[0] = 0;
+
+		KERNEL_FN(row_sub_ins) (sr, ir, dr, sr - stride, ir - stride, dr - stride, prevscore,
+								prof + dp -> code[(unsigned char) s1[w-1]] * dp -> profstride, m);
+
+		// 2.
+		de = dr[0];
+		for (r = 1; r <= m; ++r) {
+			de = max (de + K_GAP, dr[r]);
+			de = max (de, 0);
+			dr[r] = de;
+		}
+
+		// The best cell is the first to reach the highest score in the
+		// reference's row-major order, which is by read position, then by
+		// window position.
+		rowmax = KERNEL_FN(row_scores) (currscore, sr, ir, dr, m);
+		if (rowmax > maxm) {
+			for (r = 1; currscore[r] != rowmax; ++r);
+			maxm = rowmax; *maxi = r; *maxj = w;
+		} else if (rowmax == maxm && maxm > 0) {
+			// A tie only wins at an earlier read position.
+			for (r = 1; r < *maxi && currscore[r] != rowmax; ++r);
+			if (r < *maxi) {
+				*maxi = r; *maxj = w;
+			}
+		}
+		swap = prevscore; prevscore = currscore; currscore = swap;
+	}
+	return maxm;
+}
+
+
+static int KERNEL_FN(cell) (DPTABLE *dp, int *type, int i, int j)
+// Return the score at read position i, window position j and store its type
+// (S, I, or D), as calc_t_loc does.
+{
+	int k = j * dp -> stride + i;
+	int sb = ((LANE*) dp -> sub)[k];
+	int in = ((LANE*) dp -> ins)[k];
+	int de = ((LANE*) dp -> del)[k];
+	int maxm = max4 (sb, in, de, 0);
+	if (maxm == 0) *type = -1;
+	else if (maxm == de) *type = D;
+	else if (maxm == in) *type = I;
+	else *type = S;
+	return maxm;
+}
+
+
+static int KERNEL_FN(traceback) (DPTABLE *dp, int maxi, int maxj, char *s1,
+									int *match, int *mismatch, int *gap, int *hgap)
+// Trace back from the best cell, counting matches, mismatches and gaps, as
+// traceback_loc does, and return the window position the alignment starts at.
+{
+	char *s2 = dp -> query;
+	int score, tmp, type;
+	int i = maxi, j = maxj;
+
+	score = KERNEL_FN(cell) (dp, &type, i, j);
+	while (type >= 0 && (i > 0 || j > 0)) {
+		switch (type) {
+			case S:	// substitution
+				score = KERNEL_FN(cell) (dp, &type, i-1, j-1);
+				if (((s1[j-1] == s2[i-1])? K_MATCH : K_MISMATCH) == K_MATCH) {
+					++(*match);
+				} else {
+					++(*mismatch);
+				}
+				--i; --j;
+				break;
+			case D:	// deletion
+				tmp = score;
+				score = KERNEL_FN(cell) (dp, &type, i-1, j);
+				if ((tmp - K_HGAP - K_GAP) == score) ++(*hgap);
+				++(*gap);
+				--i;
+				break;
+			case I:	// insertion
+				tmp = score;
+				score = KERNEL_FN(cell) (dp, &type, i, j-1);
+				if ((tmp - K_HGAP - K_GAP) == score) ++(*hgap);
+				++(*gap);
+				--j;
+				break;
+		}
+	}
+	return j;
+}
+
+#endif
@@ -0,0 +1,251 @@
+// ============================================================================
+// alignbench times each alignment kernel in alignsrc on synthetic read and
+// window pairs over a range of read lengths and divergences, and checks that
+// every kernel reports exactly the score and match/length counts of the
+// reference kernel.  Results are printed as a single JSON object on stdout;
+// the exit status is nonzero if any kernel disagrees with the reference.
+//
+// Each window is twice the read length, as when mapping, with the read
+// sampled from its middle and mutated at the given divergence: 80% of the
+// divergence as substitutions and 10% each as insertions and deletions.
+// ============================================================================
+
+
+#include "../mapsrc/mapread.h"
+
+
+#define MAX_CONFIGS		32		// Most lengths or divergences per run.
+
+
+// Benchmark settings.
+struct benchparms {
+	unsigned long seed;				// Seed for the random number generator.
+	int pairs;						// Read/window pairs per configuration.
+	int repeats;					// Timed passes per kernel; the fastest is kept.
+	int lengths[MAX_CONFIGS];		// Read lengths to test.
+	int numlengths;
+	double diverge[MAX_CONFIGS];	// Divergences to test.
+	int numdiverge;
+};
+
+// A read/window pair and the reference kernel's result for it.
+struct pair {
+	char *read;
+	char *window;
+	int windowlen;
+	int score;
+	int matchalign[2];
+};
+
+
+// ============================================================================
+// Random number generation (splitmix64), as in simreads.
+// ============================================================================
+
+static unsigned long long rngstate;
+
+unsigned long long next_random ()
+// Return the next 64 random bits.
+{
+	unsigned long long z = (rngstate += 0x9E3779B97F4A7C15ULL);
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	return z ^ (z >> 31);
+}
+
+double uniform ()
+// Return a random double in [0, 1).
+{
+	return (next_random () >> 11) * (1.0 / 9007199254740992.0);
+}
+
+char random_base ()
+// Return a random base.
+{
+	return "ACGT"[next_random () & 3];
+}
+
+
+// ============================================================================
+// Pair generation and timing
+// ============================================================================
+
+
+double elapsed_ms (struct timeval *start, struct timeval *end)
+// Return the time elapsed between start and end in milliseconds.
+{
+	double elapsed;
+	elapsed = (end -> tv_sec - start -> tv_sec) * 1000.0;      // sec to ms
+	elapsed += (end -> tv_usec - start -> tv_usec) / 1000.0;   // us to ms
+	return elapsed;
+}
+
+
+void make_pair (struct pair *pair, int readlen, double diverge)
+// Generate a random window of twice the read length and a read sampled from
+// its middle at the given divergence.
+{
+	int i, j, w = 2 * readlen;
+
+	pair -> window = (char*) malloc (w + 1);
+	pair -> read = (char*) malloc (readlen + 1);
+	if (!pair -> window || !pair -> read) {
+		perror ("Unable to allocate pair");
+		exit (1);
+	}
+	for (i = 0; i < w; ++i) {
+		pair -> window[i] = random_base ();
+	}
+	pair -> window[w] = 0;
+	pair -> windowlen = w;
+
+	for (i = 0, j = readlen / 2; i < readlen; ) {
+		if (uniform () < diverge * 0.1) {			// Deletion
+			++j;
+		} else if (uniform () < diverge * 0.1) {	// Insertion
+			pair -> read[i++] = random_base ();
+		} else if (j < w) {
+			pair -> read[i++] = (uniform () < diverge * 0.8)?
+								random_base () : pair -> window[j];
+			++j;
+		} else {
+			pair -> read[i++] = random_base ();
+		}
+	}
+	pair -> read[readlen] = 0;
+}
+
+
+int parse_list (char *arg, int *ints, double *doubles)
+// Parse a comma-separated list into ints or doubles, whichever is given.
+// Return the number of entries.
+{
+	char *tok;
+	int n = 0;
+	for (tok = strtok (arg, ","); tok && n < MAX_CONFIGS; tok = strtok (NULL, ",")) {
+		if (ints) ints[n++] = atoi (tok);
+		else doubles[n++] = atof (tok);
+	}
+	return n;
+}
+
+
+void print_usage_and_exit ()
+// Advise the user of usage and exit.
+{
+	printf ("USAGE: alignbench [options] [parameter file]\n");
+	printf ("  -s <seed>          random seed (1)\n");
+	printf ("  -n <pairs>         read/window pairs per configuration (200)\n");
+	printf ("  -r <repeats>       timed passes per kernel (3)\n");
+	printf ("  -l <l1,l2,...>     read lengths (50,100,150,250,500)\n");
+	printf ("  -d <d1,d2,...>     divergences (0,0.02,0.05,0.1,0.2)\n");
+	exit (1);
+}
+
+
+int main (int argc, char *argv[])
+{
+	struct benchparms parms = { 1, 200, 3, { 50, 100, 150, 250, 500 }, 5,
+								{ 0.0, 0.02, 0.05, 0.1, 0.2 }, 5 };
+	struct timeval start, end;
+	struct pair *pairs;
+	CELL **reftable;
+	void **tables;
+	int opt, l, d, k, p, r, score, matchalign[2], mismatches, failed = 0, first = 1;
+	long cells;
+	double ms, best;
+	WORK work;
+
+	while ((opt = getopt (argc, argv, "s:n:r:l:d:")) != -1) {
+		switch (opt) {
+			case 's': parms.seed = strtoul (optarg, NULL, 10); break;
+			case 'n': parms.pairs = atoi (optarg); break;
+			case 'r': parms.repeats = atoi (optarg); break;
+			case 'l': parms.numlengths = parse_list (optarg, parms.lengths, NULL); break;
+			case 'd': parms.numdiverge = parse_list (optarg, NULL, parms.diverge); break;
+			default: print_usage_and_exit ();
+		}
+	}
+	if (optind < argc - 1 || parms.pairs < 1 || parms.repeats < 1) print_usage_and_exit ();
+	for (l = 0; l < parms.numlengths; ++l) {
+		// Tables are sized as the mapper sizes them.
+		if (parms.lengths[l] < 1 || parms.lengths[l] > READ_LENGTH - 2) {
+			printf ("Read lengths must be between 1 and %d.\n", READ_LENGTH - 2);
+			exit (1);
+		}
+	}
+	read_parms ((optind < argc)? argv[optind] : "INPUTS/parameters.config");
+	rngstate = parms.seed;
+
+	pairs = (struct pair*) malloc (sizeof (struct pair) * parms.pairs);
+	tables = (void**) malloc (sizeof (void*) * num_align_kernels);
+	if (!pairs || !tables) {
+		perror ("Unable to allocate pairs");
+		exit (1);
+	}
+	allocate_table (&reftable, READ_LENGTH*2, READ_LENGTH);
+	for (k = 0; k < num_align_kernels; ++k) {
+		tables[k] = align_kernels[k].alloc (READ_LENGTH*2, READ_LENGTH);
+	}
+
+	printf ("{\n");
+	printf ("  \"scoring\": {\"match\": %d, \"mismatch\": %d, \"hgap\": %d, \"gap\": %d},\n",
+			MATCH, MISMATCH, HGAP, GAP);
+	printf ("  \"pairs_per_config\": %d,\n", parms.pairs);
+	printf ("  \"results\": [");
+	for (l = 0; l < parms.numlengths; ++l) {
+		for (d = 0; d < parms.numdiverge; ++d) {
+			// Generate the pairs and record the reference result for each.
+			for (p = 0; p < parms.pairs; ++p) {
+				make_pair (&pairs[p], parms.lengths[l], parms.diverge[d]);
+				pairs[p].score = align_loc_ref (pairs[p].window, pairs[p].windowlen, pairs[p].read,
+											pairs[p].matchalign, &reftable, NULL);
+			}
+
+			for (k = 0; k < num_align_kernels; ++k) {
+				best = -1.0;
+				mismatches = 0;
+				for (r = 0; r < parms.repeats; ++r) {
+					cells = 0;
+					gettimeofday (&start, NULL);
+					for (p = 0; p < parms.pairs; ++p) {
+						score = align_kernels[k].align (pairs[p].window, pairs[p].windowlen,
+									pairs[p].read, matchalign, tables[k], &work);
+						cells += work.cells;
+						if (r == 0 && (score != pairs[p].score
+								|| matchalign[0] != pairs[p].matchalign[0]
+								|| matchalign[1] != pairs[p].matchalign[1])) {
+							++mismatches;
+						}
+					}
+					gettimeofday (&end, NULL);
+					ms = elapsed_ms (&start, &end);
+					if (best < 0.0 || ms < best) best = ms;
+				}
+				failed += mismatches;
+				printf ("%s\n    {\"kernel\": \"%s\", \"read_length\": %d, \"divergence\": %.3lf, "
+						"\"cells\": %ld, \"ms\": %.3lf, \"cells_per_sec\": %.1lf, \"mismatches\": %d}",
+						(first)? "" : ",", align_kernels[k].name, parms.lengths[l],
+						parms.diverge[d], cells, best,
+						(best > 0.0)? cells * 1000.0 / best : 0.0, mismatches);
+				first = 0;
+			}
+
+			for (p = 0; p < parms.pairs; ++p) {
+				free (pairs[p].read);
+				free (pairs[p].window);
+			}
+		}
+	}
+	printf ("\n  ],\n");
+	printf ("  \"all_match\": %s\n", (failed)? "false" : "true");
+	printf ("}\n");
+
+	for (k = 0; k < num_align_kernels; ++k) {
+		align_kernels[k].release (tables[k], READ_LENGTH*2, READ_LENGTH);
+	}
+	free_table (&reftable, READ_LENGTH*2, READ_LENGTH);
+	free (tables);
+	free (pairs);
+	return failed != 0;
+}
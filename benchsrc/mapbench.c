@@ -0,0 +1,140 @@
+// ============================================================================
+// mapbench runs the mapping pipeline over a reference and read set, timing
+// each stage, and reports the results as a single JSON object on stdout.
+// Reads named by simreads carry their true origin, which is used to score
+// mapping accuracy.
+// ============================================================================
+
+
+#include <sys/resource.h>
+#include "../mapsrc/mapread.h"
+
+
+// A hit is correct if it lies on the read's true contig and overlaps at
+// least this fraction of the read's true extent.
+#define MIN_OVERLAP		0.5
+
+
+double elapsed_ms (struct timeval *start, struct timeval *end)
+// Return the time elapsed between start and end in milliseconds.
+{
+	double elapsed;
+	elapsed = (end -> tv_sec - start -> tv_sec) * 1000.0;      // sec to ms
+	elapsed += (end -> tv_usec - start -> tv_usec) / 1000.0;   // us to ms
+	return elapsed;
+}
+
+
+int hit_is_correct (struct mapindex *index, char *readname, int readlen, struct hit *hit)
+// Compare a hit against the origin recorded in a simulated read's name.
+// Return 1 if correct, 0 if not, and -1 if the name records no origin.
+{
+	char contig[NAME_LENGTH], strand;
+	long pos, lo, hi;
+
+	if (sscanf (readname, ">sim%*d_%255[^_]_%ld_%c", contig, &pos, &strand) != 3) {
+		return -1;
+	}
+	if (hit -> contig < 0 || strcmp (contig, index -> contignames[hit -> contig]) != 0) {
+		return 0;
+	}
+	lo = (pos > hit -> start)? pos : hit -> start;
+	hi = (pos + readlen < hit -> end)? pos + readlen : hit -> end;
+	return hi - lo >= MIN_OVERLAP * readlen;
+}
+
+
+int main (int argc, char *argv[])
+{
+	char *alphabet, *genome, **names, *batch[SEED_BATCH_MAX];
+	char chunk[SEED_BATCH_MAX][READ_LENGTH], readnames[SEED_BATCH_MAX][NAME_LENGTH];
+	pos_t *starts;
+	int numcontigs, reads = 0, mapped = 0, correct = 0, truth = 0, ok, k, n;
+	long bases = 0, candidates = 0;
+	struct timeval start, end;
+	double buildms, prepms, mapms;
+	struct mapindex *index;
+	struct rusage usage;
+	struct hit hits[SEED_BATCH_MAX];
+	DPTABLE *table;
+	FILE *fp, *rfp;
+
+	if (argc > 2 && strcmp (argv[1], "-b") == 0) {
+		SEED_BATCH = atoi (argv[2]);
+		argc -= 2; argv += 2;
+	}
+	if ((argc != 4 && argc != 5) || SEED_BATCH < 1 || SEED_BATCH > SEED_BATCH_MAX) {
+		printf ("USAGE: mapbench [-b <reads seeded together>] <FASTA genome> <FASTA reads>\n");
+		printf ("                <alphabet file> [parameter file]\n");
+		exit (1);
+	}
+	read_parms ((argc == 5)? argv[4] : "INPUTS/parameters.config");
+	read_alphabet (&alphabet, argv[3]);
+	numcontigs = read_fasta_all (&names, &starts, &genome, alphabet, argv[1]);
+	if (!numcontigs) {
+		printf ("No sequences found in %s.\n", argv[1]);
+		exit (1);
+	}
+
+	// 1. Build the suffix tree.
+	gettimeofday (&start, NULL);
+	index = build_index (genome, names, starts, numcontigs, alphabet);
+	gettimeofday (&end, NULL);
+	buildms = elapsed_ms (&start, &end);
+
+	// 2. Prepare the tree and record leaf lists.
+	gettimeofday (&start, NULL);
+	prepare_tree (index);
+	gettimeofday (&end, NULL);
+	prepms = elapsed_ms (&start, &end);
+
+	// 3. Map the reads, scoring each hit against its true origin.
+	table = new_dptable ();
+	rfp = fp = open_file_read (argv[2]);
+	gettimeofday (&start, NULL);
+	while (fp) {
+		for (n = 0; n < SEED_BATCH && (fp = get_next_read (chunk[n], readnames[n], fp)); ++n) {
+			batch[n] = chunk[n];
+		}
+		mapped += map_batch (index, n, batch, table, hits);
+		for (k = 0; k < n; ++k) {
+			candidates += hits[k].candidates;
+			bases += strlen (chunk[k]);
+			++reads;
+			if ((ok = hit_is_correct (index, readnames[k], strlen (chunk[k]), &hits[k])) >= 0) {
+				correct += ok;
+				++truth;
+			}
+		}
+	}
+	gettimeofday (&end, NULL);
+	mapms = elapsed_ms (&start, &end);
+	fclose (rfp);
+	free_dptable (table);
+
+	getrusage (RUSAGE_SELF, &usage);
+	printf ("{\n");
+	printf ("  \"reference\": \"%s\",\n", argv[1]);
+	printf ("  \"reads_file\": \"%s\",\n", argv[2]);
+	printf ("  \"genome_length\": %ld,\n", (long) (index -> contigstarts[numcontigs] - numcontigs));
+	printf ("  \"contigs\": %d,\n", numcontigs);
+	printf ("  \"reads\": %d,\n", reads);
+	printf ("  \"seed_batch\": %d,\n", SEED_BATCH);
+	printf ("  \"read_bases\": %ld,\n", bases);
+	printf ("  \"stages_ms\": {\"build\": %.3lf, \"prepare\": %.3lf, \"map\": %.3lf},\n",
+			buildms, prepms, mapms);
+	printf ("  \"reads_per_sec\": %.1lf,\n", (mapms > 0.0)? reads * 1000.0 / mapms : 0.0);
+	printf ("  \"bases_per_sec\": %.1lf,\n", (mapms > 0.0)? bases * 1000.0 / mapms : 0.0);
+	printf ("  \"alignments_per_read\": %.3lf,\n", (reads)? (double) candidates / reads : 0.0);
+	printf ("  \"peak_rss_kb\": %ld,\n", usage.ru_maxrss);
+	printf ("  \"mapped\": %d,\n", mapped);
+	printf ("  \"reads_with_truth\": %d,\n", truth);
+	printf ("  \"correct\": %d,\n", correct);
+	printf ("  \"sensitivity\": %.5lf,\n", (truth)? (double) correct / truth : 0.0);
+	printf ("  \"precision\": %.5lf\n", (mapped)? (double) correct / mapped : 0.0);
+	printf ("}\n");
+
+	free_index (index);
+	free (alphabet);
+	return 0;
+}
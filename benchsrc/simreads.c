@@ -0,0 +1,289 @@
+// ============================================================================
+// simreads generates a synthetic reference genome and reads sampled from it,
+// for benchmarking.  Everything is derived from a single seed, so the same
+// options always produce byte-identical files.
+//
+// The reference is written to <prefix>.fa and the reads to <prefix>_reads.fa.
+// Each read's name records where it came from:
+//
+//     >sim<n>_<contig>_<position>_<strand>
+//
+// where position is the 0-based start of the sampled region within the contig
+// and strand is + or -.
+// ============================================================================
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+
+#define REPEAT_UNIT		300		// Length of each repeat family.
+#define REPEAT_FAMILIES	8		// Number of distinct repeat families.
+#define REPEAT_DIVERGE	0.02	// Substitution rate between copies of a repeat.
+#define LINE_WIDTH		70		// Bases per line in the reference file.
+
+
+static const char BASES[] = "ACGT";
+
+
+// Simulation settings.
+struct simparms {
+	unsigned long seed;		// Seed for the random number generator.
+	long genomelen;			// Total bases in the reference.
+	int contigs;			// Number of contigs the reference is split into.
+	double repeat;			// Fraction of the reference made of repeat copies.
+	int numreads;			// Number of reads to sample.
+	int readlen;			// Length of each read.
+	double subst;			// Per-base substitution rate.
+	double indel;			// Per-base insertion and deletion rate (each).
+	double forward;			// Fraction of reads sampled from the forward strand.
+	const char *prefix;		// Output file prefix.
+};
+
+
+// ============================================================================
+// Random number generation (splitmix64), so output does not depend on libc.
+// ============================================================================
+
+static unsigned long long rngstate;
+
+unsigned long long next_random ()
+// Return the next 64 random bits.
+{
+	unsigned long long z = (rngstate += 0x9E3779B97F4A7C15ULL);
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	return z ^ (z >> 31);
+}
+
+double uniform ()
+// Return a random double in [0, 1).
+{
+	return (next_random () >> 11) * (1.0 / 9007199254740992.0);
+}
+
+long below (long n)
+// Return a random integer in [0, n).
+{
+	return (long) (next_random () % (unsigned long long) n);
+}
+
+char random_base ()
+// Return a random base.
+{
+	return BASES[next_random () & 3];
+}
+
+char other_base (char c)
+// Return a random base different from c.
+{
+	char b;
+	while ((b = random_base ()) == c);
+	return b;
+}
+
+char complement (char c)
+// Return the Watson-Crick complement of a base.
+{
+	switch (c) {
+		case 'A': return 'T';
+		case 'C': return 'G';
+		case 'G': return 'C';
+		default:  return 'A';
+	}
+}
+
+
+// ============================================================================
+// Reference and read generation
+// ============================================================================
+
+
+char *make_genome (struct simparms *parms)
+// Generate a random genome with the requested fraction of repeat content.
+{
+	char *genome, families[REPEAT_FAMILIES][REPEAT_UNIT];
+	long i, pos, copied = 0, target;
+	int f;
+
+	genome = (char*) malloc (parms -> genomelen + 1);
+	if (!genome) {
+		perror ("Unable to allocate genome");
+		exit (1);
+	}
+	for (i = 0; i < parms -> genomelen; ++i) {
+		genome[i] = random_base ();
+	}
+	genome[parms -> genomelen] = 0;
+
+	// Paste slightly diverged copies of a few repeat families over it.
+	for (f = 0; f < REPEAT_FAMILIES; ++f) {
+		for (i = 0; i < REPEAT_UNIT; ++i) {
+			families[f][i] = random_base ();
+		}
+	}
+	target = (long) (parms -> repeat * parms -> genomelen);
+	while (copied < target && parms -> genomelen > REPEAT_UNIT) {
+		f = below (REPEAT_FAMILIES);
+		pos = below (parms -> genomelen - REPEAT_UNIT);
+		for (i = 0; i < REPEAT_UNIT; ++i) {
+			genome[pos + i] = (uniform () < REPEAT_DIVERGE)?
+								other_base (families[f][i]) : families[f][i];
+		}
+		copied += REPEAT_UNIT;
+	}
+	return genome;
+}
+
+
+void write_genome (struct simparms *parms, char *genome, long *starts)
+// Write the genome to <prefix>.fa as the requested number of contigs and
+// record where each begins.
+{
+	char filename[1024];
+	long i, k;
+	FILE *fp;
+
+	snprintf (filename, sizeof (filename), "%s.fa", parms -> prefix);
+	if (!(fp = fopen (filename, "w"))) {
+		perror ("Unable to write reference");
+		exit (1);
+	}
+	for (k = 0; k < parms -> contigs; ++k) {
+		starts[k] = k * (parms -> genomelen / parms -> contigs);
+	}
+	starts[parms -> contigs] = parms -> genomelen;
+	for (k = 0; k < parms -> contigs; ++k) {
+		fprintf (fp, ">chr%ld\n", k + 1);
+		for (i = starts[k]; i < starts[k + 1]; ++i) {
+			putc (genome[i], fp);
+			if ((i - starts[k]) % LINE_WIDTH == LINE_WIDTH - 1 || i + 1 == starts[k + 1]) {
+				putc ('\n', fp);
+			}
+		}
+	}
+	fclose (fp);
+}
+
+
+void write_reads (struct simparms *parms, char *genome, long *starts)
+// Sample reads from the genome, apply errors, and write them to <prefix>_reads.fa.
+{
+	char filename[1024], *read, *src;
+	long pos, span;
+	int n, i, j, k, strand;
+	FILE *fp;
+
+	snprintf (filename, sizeof (filename), "%s_reads.fa", parms -> prefix);
+	if (!(fp = fopen (filename, "w"))) {
+		perror ("Unable to write reads");
+		exit (1);
+	}
+	read = (char*) malloc (parms -> readlen + 1);
+	src = (char*) malloc (2 * parms -> readlen + 1);
+	if (!read || !src) {
+		perror ("Unable to allocate read");
+		exit (1);
+	}
+
+	for (n = 0; n < parms -> numreads; ++n) {
+		// Choose a contig with probability proportional to its length, then
+		// a region long enough to survive deletions.
+		do {
+			pos = below (parms -> genomelen);
+			for (k = 0; starts[k + 1] <= pos; ++k);
+			span = starts[k + 1] - starts[k];
+		} while (span < 2 * parms -> readlen);
+		pos = starts[k] + below (span - 2 * parms -> readlen + 1);
+
+		strand = (uniform () < parms -> forward)? '+' : '-';
+		for (i = 0; i < 2 * parms -> readlen; ++i) {
+			src[i] = (strand == '+')? genome[pos + i]
+						: complement (genome[pos + 2 * parms -> readlen - 1 - i]);
+		}
+
+		// Copy the source into the read, introducing errors as we go.
+		for (i = 0, j = 0; i < parms -> readlen; ) {
+			if (uniform () < parms -> indel) {			// Deletion
+				++j;
+			} else if (uniform () < parms -> indel) {	// Insertion
+				read[i++] = random_base ();
+			} else if (uniform () < parms -> subst) {	// Substitution
+				read[i++] = other_base (src[j++]);
+			} else {
+				read[i++] = src[j++];
+			}
+		}
+		read[i] = 0;
+
+		// Report the origin of the read on the forward strand.
+		if (strand == '-') {
+			pos = pos + 2 * parms -> readlen - j;
+		}
+		fprintf (fp, ">sim%d_chr%d_%ld_%c\n%s\n", n, k + 1, pos - starts[k], strand, read);
+	}
+	free (read);
+	free (src);
+	fclose (fp);
+}
+
+
+void print_usage_and_exit ()
+// Advise the user of usage and exit.
+{
+	printf ("USAGE: simreads [options] <output prefix>\n");
+	printf ("  -s <seed>          random seed (1)\n");
+	printf ("  -g <bases>         reference length (1000000)\n");
+	printf ("  -c <contigs>       number of contigs (1)\n");
+	printf ("  -r <fraction>      fraction of reference in repeats (0.05)\n");
+	printf ("  -n <reads>         number of reads (10000)\n");
+	printf ("  -l <length>        read length (100)\n");
+	printf ("  -e <rate>          substitution rate (0.01)\n");
+	printf ("  -i <rate>          insertion and deletion rate, each (0.001)\n");
+	printf ("  -f <fraction>      fraction of reads from the forward strand (1.0)\n");
+	exit (1);
+}
+
+
+int main (int argc, char *argv[])
+{
+	struct simparms parms = { 1, 1000000, 1, 0.05, 10000, 100, 0.01, 0.001, 1.0, NULL };
+	long *starts;
+	char *genome;
+	int opt;
+
+	while ((opt = getopt (argc, argv, "s:g:c:r:n:l:e:i:f:")) != -1) {
+		switch (opt) {
+			case 's': parms.seed = strtoul (optarg, NULL, 10); break;
+			case 'g': parms.genomelen = atol (optarg); break;
+			case 'c': parms.contigs = atoi (optarg); break;
+			case 'r': parms.repeat = atof (optarg); break;
+			case 'n': parms.numreads = atoi (optarg); break;
+			case 'l': parms.readlen = atoi (optarg); break;
+			case 'e': parms.subst = atof (optarg); break;
+			case 'i': parms.indel = atof (optarg); break;
+			case 'f': parms.forward = atof (optarg); break;
+			default: print_usage_and_exit ();
+		}
+	}
+	if (optind != argc - 1 || parms.contigs < 1 || parms.readlen < 1
+			|| parms.genomelen < 2 * parms.readlen * parms.contigs) {
+		print_usage_and_exit ();
+	}
+	parms.prefix = argv[optind];
+	rngstate = parms.seed;
+
+	starts = (long*) malloc (sizeof (long) * (parms.contigs + 1));
+	if (!starts) {
+		perror ("Unable to allocate contig table");
+		exit (1);
+	}
+	genome = make_genome (&parms);
+	write_genome (&parms, genome, starts);
+	write_reads (&parms, genome, starts);
+	free (genome);
+	free (starts);
+	return 0;
+}
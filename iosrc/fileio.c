@@ -4,6 +4,10 @@
 #include "fileio.h"
 
 
+int MATCH, MISMATCH, HGAP, GAP;
+int INFLATE_THREADS = 0;
+
+
 int in_alphabet (char c, char *alphabet)
 // Check whether the given char is in the alphabet.
 {
@@ -105,6 +109,98 @@ void read_fasta (char **n1, char **s1, char *alphabet, const char *filename)
 }
 
 
+void check_length (size_t length, const char *what)
+// Exit, advising a LARGE_GENOME build, if a sequence of the given length,
+// separators and terminator included, is longer than MAX_STRING_LENGTH.
+{
+	if (length <= MAX_STRING_LENGTH) return;
+	printf ("%s is %lu characters with separators and terminator, more than the %ld this build\n"
+			"can index.  Rebuild with make clean && make LARGE_GENOME=1.\n",
+			what, (unsigned long) length, (long) MAX_STRING_LENGTH);
+	exit (1);
+}
+
+
+int read_fasta_all (char ***names, pos_t **starts, char **seq, char *alphabet, const char *filename)
+// Read every record of a fasta file into one sequence, joining consecutive
+// records with SEPARATOR so that no substring of the alphabet spans two of
+// them.  Record k occupies seq[starts[k]: starts[k+1] - 1]; starts holds one
+// extra entry past the last record so that this holds for every record.
+// Do not include characters that are not in the alphabet.
+// Return the number of records read.
+{
+	FILE *fp = NULL;
+	struct stat st;
+	int c, n = 0, size = 16; char *curr, *name;
+
+	if (!(fp = fopen (filename, "r"))) {
+		printf ("Cannot open file %s\n.", filename);
+		exit(1);
+	}
+	if (stat (filename, &st) < 0) {
+		printf ("Cannot stat file %s\n.", filename);
+		fclose (fp);
+		exit (1);
+	}
+
+	// Separators and the tree's terminator take the place of header lines,
+	// so the file size plus terminator and NUL bounds the sequence.
+	*seq = (char*) malloc (st.st_size + 2);
+	*names = (char**) malloc (sizeof (char*) * size);
+	*starts = (pos_t*) malloc (sizeof (pos_t) * (size + 1));
+
+	if (!*seq || !*names || !*starts) {
+		printf ("Malloc failed while reading fasta.\n");
+		fclose (fp);
+		exit (1);
+	}
+
+	curr = *seq;
+	c = getc (fp);
+	while (c != EOF) {
+		if (n == size) {
+			size *= 2;
+			*names = (char**) realloc (*names, sizeof (char*) * size);
+			*starts = (pos_t*) realloc (*starts, sizeof (pos_t) * (size + 1));
+			if (!*names || !*starts) {
+				printf ("Malloc failed while reading fasta.\n");
+				fclose (fp);
+				exit (1);
+			}
+		}
+		if (n > 0) *curr++ = SEPARATOR;
+		(*starts)[n] = curr - *seq;
+
+		// Read sequence name.
+		name = (*names)[n] = (char*) malloc (NAME_LENGTH);
+		if (!name) {
+			printf ("Malloc failed while reading fasta.\n");
+			fclose (fp);
+			exit (1);
+		}
+		while (c != EOF && c != ' ' && c != '\t' && c != '\n') {
+			if (c != '>' && name - (*names)[n] < NAME_LENGTH - 1) *name++ = c;
+			c = getc (fp);
+		}
+		*name = 0;
+		// Rest of header line is don't-care.
+		while (c != EOF && c != '\n') { 
+			c = getc (fp); 
+		}
+		// Read sequence up to the next record.
+		while (c != EOF && c != '>') {
+			if (in_alphabet (c, alphabet)) *curr++ = c;
+			c = getc (fp);
+		}
+		++n;
+	}
+	*curr = 0;
+	fclose (fp);
+	(*starts)[n] = curr - *seq + 1;
+	return n;
+}
+
+
 void read_parms (const char *filename)
 // Read in the match, mismatch, hgap, and gap penalties.
 {
@@ -136,11 +232,11 @@ void read_parms (const char *filename)
 
 
 FILE *open_file_read (const char *filename)
-// Return a pointer to the the open file filename.
-// Report error if unable to open.
+// Return a pointer to the the open file filename, which may be
+// gzip-compressed.  Report error if unable to open.
 {
         FILE *fp = NULL;
-        if ((fp = fopen (filename, "r")) == NULL) {
+        if ((fp = open_reads (filename)) == NULL) {
                 perror ("Error when opening file");
                 exit (1);
         }
@@ -159,8 +255,320 @@ FILE *open_file_write (const char *filename)
         return fp;
 }
 
+// ============================================================================
+// Compressed reads
+// ============================================================================
+
+// A gzip-compressed read file is inflated by a background thread that writes
+// the plain text into a pipe, so the mapper parses it as it would a plain
+// file while the next stretch is being inflated.  gzip files of several
+// members are read through as one.  A BGZF file (bgzip's blocked gzip, whose
+// members each record their own compressed size) can be split into members
+// without inflating them, so its members are inflated on INFLATE_THREADS
+// threads at once, a round of them while the last round is written out.
+
+#define INFLATE_CHUNK		(1 << 17)	// Bytes inflated per write into the pipe.
+#define INFLATE_PIPE		(1 << 20)	// Pipe capacity asked for.
+#define BGZF_MAX_BLOCK		65536		// Largest BGZF member, and its largest text.
+#define BGZF_BATCH			8			// Members per thread per round.
+
+// One background decompression.
+struct inflater {
+	int in;					// Compressed input.
+	int out;				// Write end of the pipe.
+	int threads;			// Threads inflating BGZF members, 1 to inflate it as a stream.
+};
+
+// A BGZF member and its text.
+struct bgzfblock {
+	unsigned char data[BGZF_MAX_BLOCK];
+	int size;				// Bytes of the member.
+	char text[BGZF_MAX_BLOCK];
+	int length;				// Bytes of text, -1 if the member is corrupt.
+};
+
+// A round of members, inflated together.
+struct bgzfround {
+	struct bgzfblock *blocks;
+	int count;				// Members read into the round.
+	int threads;			// Threads inflating them; thread t takes every threads-th from t.
+	int started;			// Workers running; shares from here on were inflated in place.
+	struct bgzfround *self[INFLATE_THREADS_MAX];	// What thread t is given: &self[t].
+	pthread_t workers[INFLATE_THREADS_MAX];
+};
+
+
+int write_all (int fd, const char *buf, long len)
+// Write len bytes of buf to fd.  Return 0 on success, -1 on failure.
+{
+	long n;
+	while (len > 0) {
+		if ((n = write (fd, buf, len)) < 0) return -1;
+		buf += n; len -= n;
+	}
+	return 0;
+}
+
+
+int read_fully (int fd, unsigned char *buf, int len)
+// Read up to len bytes from fd, short only at the end of the input.
+// Return the number read, -1 on failure.
+{
+	int n, got = 0;
+	while (got < len) {
+		if ((n = read (fd, buf + got, len - got)) < 0) return -1;
+		if (!n) break;
+		got += n;
+	}
+	return got;
+}
+
+
+int bgzf_size (const unsigned char *header, int n)
+// Return the size of the BGZF member the first n bytes of header begin,
+// from its BC extra subfield, or 0 if they do not begin one.
+{
+	int xlen, k;
+
+	if (n < 12 || header[0] != 0x1f || header[1] != 0x8b || header[2] != 8 || !(header[3] & 4)) {
+		return 0;
+	}
+	xlen = header[10] | header[11] << 8;
+	for (k = 12; k + 4 <= 12 + xlen && k + 4 <= n; k += 4 + (header[k + 2] | header[k + 3] << 8)) {
+		if (header[k] == 'B' && header[k + 1] == 'C' && k + 6 <= n) {
+			return (header[k + 4] | header[k + 5] << 8) + 1;
+		}
+	}
+	return 0;
+}
+
+
+int read_bgzf_block (int fd, struct bgzfblock *b)
+// Read the next member of a BGZF file.  Return 1 if one was read, 0 at the
+// end of the file, and -1 if what follows is not a whole BGZF member.
+{
+	int n, xlen;
+
+	if ((n = read_fully (fd, b -> data, 12)) <= 0) return n;
+	xlen = b -> data[10] | b -> data[11] << 8;
+	if (n < 12 || 12 + xlen + 8 > BGZF_MAX_BLOCK || read_fully (fd, b -> data + 12, xlen) != xlen) {
+		return -1;
+	}
+	b -> size = bgzf_size (b -> data, 12 + xlen);
+	if (b -> size < 12 + xlen + 8 || b -> size > BGZF_MAX_BLOCK) return -1;
+	n = b -> size - 12 - xlen;
+	return (read_fully (fd, b -> data + 12 + xlen, n) == n)? 1 : -1;
+}
+
+
+void inflate_bgzf_block (struct bgzfblock *b)
+// Inflate a member's deflate data into its text and check it against the
+// length and CRC-32 in its trailer.
+{
+	unsigned char *trailer = b -> data + b -> size - 8;
+	unsigned long crc = trailer[0] | trailer[1] << 8 | trailer[2] << 16 | (unsigned long) trailer[3] << 24;
+	int length = trailer[4] | trailer[5] << 8 | trailer[6] << 16 | trailer[7] << 24;
+	int start = 12 + (b -> data[10] | b -> data[11] << 8);
+	z_stream z;
+
+	b -> length = -1;
+	bzero (&z, sizeof (z_stream));
+	if (length < 0 || length > BGZF_MAX_BLOCK || inflateInit2 (&z, -15) != Z_OK) return;
+	z.next_in = b -> data + start;
+	z.avail_in = b -> size - 8 - start;
+	z.next_out = (unsigned char*) b -> text;
+	z.avail_out = BGZF_MAX_BLOCK;
+	if (inflate (&z, Z_FINISH) == Z_STREAM_END && z.total_out == (unsigned long) length
+			&& crc32 (0L, (unsigned char*) b -> text, length) == crc) {
+		b -> length = length;
+	}
+	inflateEnd (&z);
+}
+
+
+void *inflate_share (void *arg)
+// Inflate one thread's share of a round, given &round -> self[t] for thread t.
+{
+	struct bgzfround **self = (struct bgzfround**) arg, *round = *self;
+	int k;
+
+	for (k = self - round -> self; k < round -> count; k += round -> threads) {
+		inflate_bgzf_block (&round -> blocks[k]);
+	}
+	return NULL;
+}
+
+
+int write_round (int fd, struct bgzfround *round)
+// Wait for a round's threads, then write its text in order.  Return 0 on
+// success, -1 if a member was corrupt or the text could not be written.
+{
+	int k;
+
+	for (k = 0; k < round -> started; ++k) {
+		pthread_join (round -> workers[k], NULL);
+	}
+	for (k = 0; k < round -> count; ++k) {
+		if (round -> blocks[k].length < 0
+				|| write_all (fd, round -> blocks[k].text, round -> blocks[k].length) < 0) {
+			return -1;
+		}
+	}
+	return 0;
+}
+
+
+int inflate_bgzf (struct inflater *inf)
+// Inflate a BGZF file into the pipe, its members a round at a time on
+// inf -> threads threads.  While one round is inflated, the text of the
+// round before is written.  Return 0 on success, -1 on failure.
+{
+	struct bgzfround rounds[2], *curr, *prev = NULL;
+	int k, t, status = 1, failed = 0;
+
+	for (k = 0; k < 2; ++k) {
+		rounds[k].threads = inf -> threads;
+		rounds[k].blocks = (struct bgzfblock*) malloc (sizeof (struct bgzfblock) * BGZF_BATCH * inf -> threads);
+		if (!rounds[k].blocks) {
+			perror ("Unable to allocate BGZF members");
+			exit (1);
+		}
+	}
+	for (k = 0; !failed; ++k) {
+		curr = &rounds[k % 2];
+		for (curr -> count = 0; curr -> count < BGZF_BATCH * inf -> threads
+				&& (status = read_bgzf_block (inf -> in, &curr -> blocks[curr -> count])) > 0; ++curr -> count);
+		for (t = 0; t < inf -> threads; ++t) {
+			curr -> self[t] = curr;
+		}
+
+		// If a worker cannot be started, inflate its share and the rest here.
+		for (curr -> started = 0; curr -> started < inf -> threads
+				&& !pthread_create (&curr -> workers[curr -> started], NULL, inflate_share,
+									&curr -> self[curr -> started]); ++curr -> started);
+		for (t = curr -> started; t < inf -> threads; ++t) {
+			inflate_share (&curr -> self[t]);
+		}
+		if (prev && write_round (inf -> out, prev) < 0) failed = 1;
+		prev = curr;
+		if (status <= 0) break;
+	}
+	if (write_round (inf -> out, prev) < 0 || status < 0) failed = 1;
+	free (rounds[0].blocks);
+	free (rounds[1].blocks);
+	return (failed)? -1 : 0;
+}
+
+
+int inflate_stream (struct inflater *inf)
+// Inflate a gzip file of any number of members into the pipe, or copy it
+// through if it is not compressed.  Return 0 on success, -1 on failure.
+{
+	char *buf = (char*) malloc (INFLATE_CHUNK);
+	gzFile gz = gzdopen (inf -> in, "r");
+	int n = -1;
+
+	if (!buf || !gz) {
+		perror ("Unable to open compressed reads");
+		exit (1);
+	}
+	gzbuffer (gz, INFLATE_CHUNK);
+	while ((n = gzread (gz, buf, INFLATE_CHUNK)) > 0 && write_all (inf -> out, buf, n) == 0);
+	gzclose (gz);
+	free (buf);
+	return (n == 0)? 0 : -1;
+}
+
+
+void *run_inflater (void *arg)
+// Body of the inflating thread.  A reader that stops early closes the pipe,
+// which ends the thread's writes with EPIPE rather than a signal.  Closing
+// the pipe tells the reader the text is complete.
+{
+	struct inflater *inf = (struct inflater*) arg;
+	sigset_t pipe;
+	int failed;
+
+	sigemptyset (&pipe);
+	sigaddset (&pipe, SIGPIPE);
+	pthread_sigmask (SIG_BLOCK, &pipe, NULL);
+	if (inf -> threads > 1) {
+		failed = inflate_bgzf (inf);
+		close (inf -> in);
+	} else {
+		failed = inflate_stream (inf);
+	}
+	if (failed) fprintf (stderr, "Reads are truncated: compressed input is corrupt or could not be passed on.\n");
+	close (inf -> out);
+	free (inf);
+	return NULL;
+}
+
+
+int inflate_fd (int fd, int threads)
+// Start a thread that inflates the gzip data read from fd, or copies it if it
+// is not compressed, and return the descriptor its text can be read from.
+// With threads above 1, fd must be BGZF, and its members are inflated that
+// many at a time.  The thread closes fd when done.
+{
+	struct inflater *inf = (struct inflater*) malloc (sizeof (struct inflater));
+	pthread_attr_t attr;
+	pthread_t thread;
+	int ends[2];
+
+	if (!inf || pipe (ends) < 0) {
+		perror ("Unable to start decompression");
+		exit (1);
+	}
+#ifdef F_SETPIPE_SZ
+	fcntl (ends[1], F_SETPIPE_SZ, INFLATE_PIPE);
+#endif
+	inf -> in = fd;
+	inf -> out = ends[1];
+	inf -> threads = (threads < 1)? 1 : (threads > INFLATE_THREADS_MAX)? INFLATE_THREADS_MAX : threads;
+	pthread_attr_init (&attr);
+	pthread_attr_setdetachstate (&attr, PTHREAD_CREATE_DETACHED);
+	if (pthread_create (&thread, &attr, run_inflater, inf)) {
+		perror ("Unable to start decompression");
+		exit (1);
+	}
+	pthread_attr_destroy (&attr);
+	return ends[0];
+}
+
+
+FILE *open_reads (const char *filename)
+// Open a read file.  A gzip-compressed one is inflated on a background
+// thread, with INFLATE_THREADS threads (or one per online CPU) if it is
+// BGZF.  Return NULL if the file cannot be opened.
+{
+	unsigned char header[18];
+	int fd, n, threads = 1;
+
+	if ((fd = open (filename, O_RDONLY)) < 0) return NULL;
+	// A pipe cannot be looked into, so it is passed through the thread, which
+	// inflates it if it turns out to be compressed.
+	if ((n = pread (fd, header, sizeof (header), 0)) < 0) return fdopen (inflate_fd (fd, 1), "r");
+	if (n < 2 || header[0] != 0x1f || header[1] != 0x8b) return fdopen (fd, "r");
+	if (bgzf_size (header, n)) {
+		threads = (INFLATE_THREADS > 0)? INFLATE_THREADS : (int) sysconf (_SC_NPROCESSORS_ONLN);
+	}
+	return fdopen (inflate_fd (fd, threads), "r");
+}
+
+
+void skip_line (FILE *fp)
+// Read past the end of the current line.
+{
+	int c;
+	while ((c = getc (fp)) != EOF && c != '\n');
+}
+
+
 FILE *get_next_read (char *read, char *readname, FILE *fp)
 // Record the next read in the file and return the updated file pointer.
+// A FASTQ record is read as a FASTA one: its name is given a '>' in place
+// of its '@', and its '+' and quality lines are skipped.
 {
 	char *cp;
 	bzero (read, READ_LENGTH);
@@ -173,6 +581,11 @@ FILE *get_next_read (char *read, char *readname, FILE *fp)
 		if (fp && cp) {
 			cp = fgets (read, READ_LENGTH, fp);
 			if (cp) read[strlen(read) - 1] = 0;
+			if (readname[0] == '@') {
+				readname[0] = '>';
+				skip_line (fp);
+				skip_line (fp);
+			}
 		} else {
 			fp = 0;
 		}
@@ -182,5 +595,66 @@ FILE *get_next_read (char *read, char *readname, FILE *fp)
 }
 
 
+FILE *get_next_long_read (char **read, int *cap, char *readname, FILE *fp)
+// Record the next read in the file, of any length and possibly wrapped over
+// several lines, into *read, grown with realloc from capacity *cap, which is
+// updated.  The sequence runs up to the next line starting with '>'.  Return
+// the updated file pointer, or NULL once no read is left.  A FASTQ record's
+// sequence runs up to its '+' line, and its name is given a '>' as
+// get_next_read does; its quality lines, as long as the sequence, are
+// skipped.
+{
+	char *cp, end = '>';
+	int c, len = 0, quality;
+
+	bzero (readname, NAME_LENGTH);
+	if (!fp || !fgets (readname, NAME_LENGTH, fp)) return NULL;
+	if ((cp = strchr (readname, '\n'))) {
+		*cp = 0;
+	} else {
+		// Drop the rest of an overlong name.
+		skip_line (fp);
+	}
+	if (readname[0] == '@') {
+		readname[0] = '>';
+		end = '+';
+	}
+
+	while ((c = getc (fp)) != EOF && c != end) {
+		for (; c != EOF && c != '\n'; c = getc (fp)) {
+			if (c == '\r') continue;
+			if (len + 1 >= *cap) {
+				*cap = (*cap)? 2 * *cap : 4096;
+				*read = (char*) realloc (*read, *cap);
+				if (!*read) {
+					perror ("Unable to allocate read");
+					exit (1);
+				}
+			}
+			(*read)[len++] = c;
+		}
+	}
+	if (c == '>') {
+		ungetc (c, fp);
+	} else if (c == '+') {
+		// Quality characters may be '@' or '+', so they are counted, not parsed.
+		skip_line (fp);
+		for (quality = 0; quality < len && (c = getc (fp)) != EOF; ) {
+			if (c != '\n' && c != '\r') ++quality;
+		}
+		skip_line (fp);
+	}
+	if (!*cap) {
+		*cap = 4096;
+		if (!(*read = (char*) malloc (*cap))) {
+			perror ("Unable to allocate read");
+			exit (1);
+		}
+	}
+	(*read)[len] = 0;
+	return fp;
+}
+
+
 
 
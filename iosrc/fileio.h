@@ -10,24 +10,49 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <pthread.h>
+#include <zlib.h>
+#include "../sfxsrc/suffix.h"
 
 
 #define 	READ_LENGTH		512
 #define		NAME_LENGTH		256
 
+// Joins records of a multi-record fasta file.  Must not occur in any alphabet.
+#define		SEPARATOR		'#'
 
-int MATCH, MISMATCH, HGAP, GAP;
+
+// Most threads inflating the members of a BGZF read file at once.
+#define		INFLATE_THREADS_MAX		8
+
+
+extern int MATCH, MISMATCH, HGAP, GAP;
+extern int INFLATE_THREADS;		// Threads inflating BGZF members, 0 for one per online CPU.
 
 
 // INTERFACE PROTOTYPES
 
 
+int in_alphabet (char, char*);
 void read_parms (const char*);
 void read_fasta (char**, char**, char*, const char*);
+int read_fasta_all (char***, pos_t**, char**, char*, const char*);
+// Exit with advice if a sequence of the given length is too long to index.
+void check_length (size_t, const char*);
 void read_alphabet (char**, const char*);
 FILE *open_file_read (const char*);
+// Open a read file, plain or gzip-compressed, NULL if it cannot be opened.
+FILE *open_reads (const char*);
+// Decompress a descriptor on a background thread, given the threads for BGZF
+// members, and return the descriptor the plain text can be read from.
+int inflate_fd (int, int);
+// Write all of a buffer to a descriptor; 0 on success, -1 on failure.
+int write_all (int, const char*, long);
 FILE *open_file_write (const char*);
 FILE *get_next_read (char*,char*,FILE*);
+FILE *get_next_long_read (char**,int*,char*,FILE*);
 
 
 
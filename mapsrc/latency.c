@@ -0,0 +1,210 @@
+#include "latency.h"
+
+
+// ============================================================================
+// latency.c implements the per-read latency histogram and the slow-read
+// tracker.  Both are cheap enough to update for every read.
+// ============================================================================
+
+
+long now_ns ()
+// Return the current monotonic time in nanoseconds.
+{
+	struct timespec ts;
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+
+int hist_bucket (long value)
+// Return the bucket holding the given value.  Values below HIST_SUB get a
+// bucket each; above that, the position of the leading bit picks the power of
+// two and the next HIST_SUB_BITS bits pick the bucket within it.
+{
+	int msb;
+	if (value < HIST_SUB) {
+		return (value < 0)? 0 : value;
+	}
+	msb = 63 - __builtin_clzl (value);
+	return (msb - HIST_SUB_BITS + 1) * HIST_SUB
+			+ ((value >> (msb - HIST_SUB_BITS)) & (HIST_SUB - 1));
+}
+
+
+long hist_bucket_top (int bucket)
+// Return the largest value held by the given bucket.
+{
+	int shift;
+	if (bucket < HIST_SUB) {
+		return bucket;
+	}
+	shift = bucket / HIST_SUB - 1;
+	return (((long) (HIST_SUB + bucket % HIST_SUB) + 1) << shift) - 1;
+}
+
+
+void hist_add (struct histogram *hist, long value)
+// Record one value in the histogram.
+{
+	++hist -> counts[hist_bucket (value)];
+	++hist -> total;
+	if (value > hist -> max) hist -> max = value;
+}
+
+
+void hist_merge (struct histogram *into, struct histogram *from)
+// Fold the counts of one histogram into another.
+{
+	int b;
+	for (b = 0; b < HIST_BUCKETS; ++b) {
+		into -> counts[b] += from -> counts[b];
+	}
+	into -> total += from -> total;
+	if (from -> max > into -> max) into -> max = from -> max;
+}
+
+
+long hist_percentile (struct histogram *hist, double percent)
+// Return the top of the bucket holding the given percentile, capped at the
+// largest value recorded.
+{
+	long rank, seen = 0;
+	int b;
+
+	if (!hist -> total) return 0;
+	rank = (long) (percent / 100.0 * hist -> total + 0.5);
+	if (rank < 1) rank = 1;
+	for (b = 0; b < HIST_BUCKETS; ++b) {
+		seen += hist -> counts[b];
+		if (seen >= rank) break;
+	}
+	return (hist_bucket_top (b) < hist -> max)? hist_bucket_top (b) : hist -> max;
+}
+
+
+// ============================================================================
+// Slow-read tracker
+// ============================================================================
+
+
+void init_slowreads (struct slowreads *slow, int size)
+// Prepare to keep the given number of slowest reads.
+{
+	slow -> count = 0;
+	slow -> size = size;
+	slow -> heap = (struct slowread*) calloc (size, sizeof (struct slowread));
+	if (size && !slow -> heap) {
+		perror ("Unable to allocate slow-read tracker");
+		exit (1);
+	}
+}
+
+
+long slow_total (struct slowread *entry)
+// Total latency of a tracked read.
+{
+	return entry -> seedns + entry -> alignns;
+}
+
+
+void sift_down (struct slowreads *slow, int i)
+// Restore the min-heap property below position i.
+{
+	struct slowread tmp;
+	int child;
+	while ((child = 2 * i + 1) < slow -> count) {
+		if (child + 1 < slow -> count
+				&& slow_total (&slow -> heap[child + 1]) < slow_total (&slow -> heap[child])) {
+			++child;
+		}
+		if (slow_total (&slow -> heap[i]) <= slow_total (&slow -> heap[child])) break;
+		tmp = slow -> heap[i]; slow -> heap[i] = slow -> heap[child]; slow -> heap[child] = tmp;
+		i = child;
+	}
+}
+
+
+void sift_up (struct slowreads *slow, int i)
+// Restore the min-heap property above position i.
+{
+	struct slowread tmp;
+	int parent;
+	while (i > 0 && slow_total (&slow -> heap[(parent = (i - 1) / 2)]) > slow_total (&slow -> heap[i])) {
+		tmp = slow -> heap[i]; slow -> heap[i] = slow -> heap[parent]; slow -> heap[parent] = tmp;
+		i = parent;
+	}
+}
+
+
+void offer_slowread (struct slowreads *slow, char *name, char *read,
+						long seedns, long alignns, int candidates)
+// Keep the read if it is among the slowest seen so far.
+{
+	struct slowread *entry;
+
+	if (!slow -> size) return;
+	if (slow -> count == slow -> size) {
+		// Full: only keep the read if it beats the fastest one kept.
+		if (seedns + alignns <= slow_total (&slow -> heap[0])) return;
+		entry = &slow -> heap[0];
+		free (entry -> name);
+		free (entry -> read);
+	} else {
+		entry = &slow -> heap[slow -> count++];
+	}
+	entry -> name = strdup (name);
+	entry -> read = strdup (read);
+	entry -> seedns = seedns;
+	entry -> alignns = alignns;
+	entry -> candidates = candidates;
+	if (entry == &slow -> heap[0] && slow -> count == slow -> size) {
+		sift_down (slow, 0);
+	} else {
+		sift_up (slow, entry - slow -> heap);
+	}
+}
+
+
+void write_slowreads (struct slowreads *slow, FILE *fp)
+// Write the kept reads to fp, slowest first, as FASTA whose headers carry
+// each read's latencies and candidate count.  The file can be mapped again
+// as a read file.  The tracker is emptied.
+{
+	struct slowread *sorted, entry;
+	int n = slow -> count, i;
+
+	sorted = (struct slowread*) malloc (sizeof (struct slowread) * (n + 1));
+	if (!sorted) {
+		perror ("Unable to allocate slow-read list");
+		exit (1);
+	}
+	// Pop the heap, fastest first, and write in reverse.
+	for (i = n - 1; i >= 0; --i) {
+		sorted[i] = slow -> heap[0];
+		slow -> heap[0] = slow -> heap[--slow -> count];
+		sift_down (slow, 0);
+	}
+	for (i = 0; i < n; ++i) {
+		entry = sorted[i];
+		fprintf (fp, "%s seed_ns=%ld align_ns=%ld total_ns=%ld candidates=%d\n%s\n",
+				entry.name, entry.seedns, entry.alignns, slow_total (&entry),
+				entry.candidates, entry.read);
+		free (entry.name);
+		free (entry.read);
+	}
+	free (sorted);
+}
+
+
+void free_slowreads (struct slowreads *slow)
+// Release the tracker and any reads it still holds.
+{
+	int i;
+	for (i = 0; i < slow -> count; ++i) {
+		free (slow -> heap[i].name);
+		free (slow -> heap[i].read);
+	}
+	free (slow -> heap);
+	slow -> heap = NULL;
+	slow -> count = slow -> size = 0;
+}
@@ -0,0 +1,67 @@
+#ifndef LATENCY_H_
+#define LATENCY_H_
+
+
+// ============================================================================
+// latency.h declares the per-read latency histogram and the tracker that
+// keeps the slowest reads of a run for later study.
+// ============================================================================
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+
+// Each power of two is split into 2^HIST_SUB_BITS buckets, so a recorded
+// value is known to within 1 / 2^HIST_SUB_BITS of itself.
+
+#define HIST_SUB_BITS		3
+#define HIST_SUB			(1 << HIST_SUB_BITS)
+#define HIST_BUCKETS		(64 * HIST_SUB)
+
+
+// Log-bucketed histogram of latencies in nanoseconds.
+struct histogram {
+	long counts[HIST_BUCKETS];	// Number of values recorded in each bucket.
+	long total;					// Number of values recorded.
+	long max;					// Largest value recorded.
+};
+
+// One read kept by the slow-read tracker.
+struct slowread {
+	char *name;				// Read name, as given in the read file.
+	char *read;				// Read sequence.
+	long seedns;			// Time spent seeding the read.
+	long alignns;			// Time spent aligning it.
+	int candidates;			// Number of candidate locations aligned.
+};
+
+// The slowest reads seen so far, kept as a min-heap on total latency.
+struct slowreads {
+	struct slowread *heap;	// Heap of the slowest reads.
+	int count;				// Number of reads in the heap.
+	int size;				// Number of reads to keep.
+};
+
+
+// Interface Prototypes ===========
+
+// Return the current monotonic time in nanoseconds.
+long now_ns ();
+// Record one value in a histogram.
+void hist_add (struct histogram*, long);
+// Fold the second histogram into the first.
+void hist_merge (struct histogram*, struct histogram*);
+// Return the value below which the given percentage of recorded values fall.
+long hist_percentile (struct histogram*, double);
+// Keep up to n of the slowest reads offered to the tracker.
+void init_slowreads (struct slowreads*, int);
+void offer_slowread (struct slowreads*, char*, char*, long, long, int);
+// Write the kept reads, slowest first, as annotated FASTA, and release them.
+void write_slowreads (struct slowreads*, FILE*);
+void free_slowreads (struct slowreads*);
+
+
+#endif
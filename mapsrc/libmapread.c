@@ -0,0 +1,244 @@
+#include "libmapread.h"
+#include "mapread.h"
+
+
+// ============================================================================
+// libmapread.c implements the embeddable interface on top of the index and
+// per-read mapping routines used by the command line tool.
+// ============================================================================
+
+
+void mapread_set_scoring (int match, int mismatch, int hgap, int gap)
+// Set the alignment scores used by every index.
+{
+	MATCH = match;
+	MISMATCH = mismatch;
+	HGAP = hgap;
+	GAP = gap;
+}
+
+
+void mapread_set_thresholds (double identity, double coverage)
+// Set the minimum identity and coverage percentages for a read to be a hit.
+{
+	X = identity;
+	Y = coverage;
+}
+
+
+void mapread_set_seed_batch (int n)
+// Set how many reads are seeded together, from 1 to SEED_BATCH_MAX.
+{
+	SEED_BATCH = (n < 1)? 1 : (n > SEED_BATCH_MAX)? SEED_BATCH_MAX : n;
+}
+
+
+void mapread_set_approx (int edits, long budget)
+// Set the edits an approximate seed may have and the work budget per read.
+{
+	APPROX_EDITS = (edits > 0)? edits : 0;
+	APPROX_BUDGET = (budget > 0)? budget : DEFAULT_APPROX_BUDGET;
+}
+
+
+void mapread_set_seeding (int seeds, int k, int w, int maxocc)
+// Choose the seeding index and its minimizer parameters.  The
+// MAPREAD_SEEDS_* values match mapread's SEEDS_* indexes.
+{
+	SEED_INDEX = seeds;
+	MINIMIZER_K = (k > 0 && k <= MAX_MINIMIZER_K)? k : DEFAULT_MINIMIZER_K;
+	MINIMIZER_W = (w > 0 && w <= MAX_MINIMIZER_W)? w : DEFAULT_MINIMIZER_W;
+	MAX_OCC = (maxocc > 0)? maxocc : DEFAULT_MAX_OCC;
+}
+
+
+void mapread_set_long_reads (int on)
+// Map later batches as long reads, whole and by chaining, or as short ones.
+{
+	LONG_READS = on != 0;
+}
+
+
+void mapread_set_exit_policy (int policy, int n)
+// Set when a read stops evaluating its candidate locations.  The
+// MAPREAD_EXIT_* values match mapread's EXIT_* policies.
+{
+	EXIT_POLICY = policy;
+	EXIT_N = (n > 0)? n : 1;
+}
+
+
+struct mapindex *mapread_build_index (const char **names, const char **seqs, int numseqs,
+										const char *alphabet)
+// Concatenate the given sequences into one genome, joined by SEPARATOR and
+// restricted to the alphabet, then build and prepare an index over it.
+{
+	char *genome, *curr, *alpha, **contignames;
+	const char *cp;
+	int k;
+	pos_t *starts;
+	size_t total;
+	struct mapindex *index;
+
+	if (numseqs < 1) return NULL;
+
+	// Room for every sequence, the separators, the terminator, and NUL, which
+	// this build's positions must be able to address.
+	total = numseqs + 1;
+	for (k = 0; k < numseqs; ++k) {
+		total += strlen (seqs[k]);
+	}
+	if (total - 1 > MAX_STRING_LENGTH) return NULL;
+	genome = (char*) malloc (total);
+	contignames = (char**) malloc (sizeof (char*) * numseqs);
+	starts = (pos_t*) malloc (sizeof (pos_t) * (numseqs + 1));
+	alpha = strdup (alphabet);
+	if (!genome || !contignames || !starts || !alpha) {
+		free (genome); free (contignames); free (starts); free (alpha);
+		return NULL;
+	}
+
+	curr = genome;
+	for (k = 0; k < numseqs; ++k) {
+		if (k > 0) *curr++ = SEPARATOR;
+		starts[k] = curr - genome;
+		for (cp = seqs[k]; *cp; ++cp) {
+			if (in_alphabet (*cp, alpha)) *curr++ = *cp;
+		}
+		contignames[k] = strdup ((names)? names[k] : "");
+	}
+	*curr = 0;
+	starts[numseqs] = curr - genome + 1;
+
+	if (curr == genome) {	// Nothing to index.
+		for (k = 0; k < numseqs; ++k) {
+			free (contignames[k]);
+		}
+		free (genome); free (contignames); free (starts); free (alpha);
+		return NULL;
+	}
+
+	index = build_index (genome, contignames, starts, numseqs, alpha);
+	prepare_tree (index);
+	free (alpha);
+	return index;
+}
+
+
+struct mapindex *mapread_load_index (const char *fastafile, const char *alphabet)
+// Build and prepare an index over every record of the given FASTA file.
+// Return NULL, as mapread_build_index does, if it is too long to index.
+{
+	char *genome, *alpha, **names;
+	pos_t *starts;
+	int numcontigs, k;
+	struct mapindex *index;
+
+	if (access (fastafile, R_OK) < 0 || !(alpha = strdup (alphabet))) {
+		return NULL;
+	}
+	numcontigs = read_fasta_all (&names, &starts, &genome, alpha, fastafile);
+	if (!numcontigs || !genome[0] || strlen (genome) + 1 > MAX_STRING_LENGTH) {
+		for (k = 0; k < numcontigs; ++k) {
+			free (names[k]);
+		}
+		free (genome); free (names); free (starts); free (alpha);
+		return NULL;
+	}
+	index = build_index (genome, names, starts, numcontigs, alpha);
+	prepare_tree (index);
+	free (alpha);
+	return index;
+}
+
+
+int mapread_num_contigs (struct mapindex *index)
+// Return the number of contigs in the index.
+{
+	return index -> numcontigs;
+}
+
+
+const char *mapread_contig_name (struct mapindex *index, int contig)
+// Return the name of the given contig.
+{
+	return (contig >= 0 && contig < index -> numcontigs)? index -> contignames[contig] : NULL;
+}
+
+
+int mapread_map_batch (struct mapindex *index, const char **reads, int numreads,
+						struct mapread_hit *results)
+// Map each read of the batch onto the index and store its best hit in the
+// matching slot of results.  Reads longer than READ_LENGTH - 1 are truncated,
+// as they are when read from a file, unless long reads are enabled.  Return
+// the number of reads that mapped.
+{
+	char chunk[SEED_BATCH_MAX][READ_LENGTH], *batch[SEED_BATCH_MAX];
+	struct hit hits[SEED_BATCH_MAX], *hit;
+	DPTABLE *table;
+	int i, k, n, mapped = 0;
+
+	table = new_dptable ();
+	for (i = 0; i < numreads; i += n) {
+		// Copy out the next chunk of reads and map them together.  Long
+		// reads are mapped in place, one at a time.
+		for (n = 0; n < SEED_BATCH_MAX && i + n < numreads; ++n) {
+			if (LONG_READS) {
+				map_long_read (nearest_index (index), (char*) reads[i + n], table, &hits[n]);
+				continue;
+			}
+			strncpy (chunk[n], reads[i + n], READ_LENGTH - 1);
+			chunk[n][READ_LENGTH - 1] = 0;
+			batch[n] = chunk[n];
+		}
+		if (!LONG_READS) map_batch (nearest_index (index), n, batch, table, hits);
+
+		for (k = 0; k < n; ++k) {
+			hit = &hits[k];
+			results[i + k].mapped = hit -> contig >= 0;
+			results[i + k].contig = hit -> contig;
+			results[i + k].candidates = hit -> candidates;
+			if (results[i + k].mapped) {
+				results[i + k].contigname = index -> contignames[hit -> contig];
+				results[i + k].start = hit -> start;
+				results[i + k].end = hit -> end;
+				results[i + k].identity = hit -> identity;
+				results[i + k].coverage = hit -> coverage;
+				++mapped;
+			} else {
+				results[i + k].contigname = NULL;
+				results[i + k].start = results[i + k].end = -1;
+				results[i + k].identity = results[i + k].coverage = 0.0;
+			}
+		}
+	}
+	free_dptable (table);
+	return mapped;
+}
+
+
+void mapread_enable_cache (struct mapindex *index, int entries)
+// Cache the results of reads mapped against the index.
+{
+	enable_cache (index, entries);
+}
+
+
+int mapread_place_index (struct mapindex *index, int pages, int replicate)
+// Place the index's tree nodes, leaf array and genome on the given page
+// backing, and replicate them per NUMA node if asked.  The MAPREAD_PAGES_*
+// values match mapread's PAGES_* backings.
+{
+	if (!index -> replicas) {
+		place_index (index, pages);
+		if (replicate) replicate_index (index, pages);
+	}
+	return index -> backing;
+}
+
+
+void mapread_free_index (struct mapindex *index)
+// Free an index and everything it owns.
+{
+	free_index (index);
+}
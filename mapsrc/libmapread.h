@@ -0,0 +1,97 @@
+#ifndef LIBMAPREAD_H_
+#define LIBMAPREAD_H_
+
+
+// ============================================================================
+// libmapread.h declares the embeddable interface to the read mapper.  An index
+// is built from in-memory sequences (or loaded from a FASTA file), batches of
+// in-memory reads are mapped against it into a caller-provided result array,
+// and the index is freed.  None of these calls write to stdout, and only
+// mapread_load_index reads from the filesystem.
+//
+// Indexes are independent and read-only once built, so any number may be
+// resident and each may be mapped against from several threads at once.  The
+// scoring scheme and hit thresholds are process-wide settings.
+// ============================================================================
+
+
+struct mapindex;
+
+
+// When a read may stop evaluating the locations its seed occurs at.
+#define MAPREAD_EXIT_ALL	0	// Evaluate every location.
+#define MAPREAD_EXIT_FIRST	1	// Stop at the first hit.
+#define MAPREAD_EXIT_BEST	2	// Stop at the first perfect hit: the whole read, exactly.
+#define MAPREAD_EXIT_TOP	3	// Stop once a given number of locations have been hits.
+
+// Page backing for an index's tree nodes, leaf array and genome.
+#define MAPREAD_PAGES_NORMAL	0	// Ordinary pages.
+#define MAPREAD_PAGES_THP		1	// Transparent huge pages.
+#define MAPREAD_PAGES_HUGETLB	2	// Explicit huge pages, else transparent ones.
+
+
+// Index an index seeds reads from.
+#define MAPREAD_SEEDS_TREE		0	// Longest exact match in a suffix tree.
+#define MAPREAD_SEEDS_MINIMIZER	1	// Shared (w,k)-minimizers; a much smaller index.
+#define MAPREAD_SEEDS_LAZY		2	// As TREE, the tree only built where reads reach it.
+
+
+// Best hit found for one read of a batch.
+struct mapread_hit {
+	int mapped;				// 1 if the read mapped, 0 if not.
+	int contig;				// Index of the contig hit, -1 if the read did not map.
+	const char *contigname;	// Name of the contig hit, NULL if the read did not map.
+	long start;				// First position of the hit within the contig.
+	long end;				// Last+1 position of the hit within the contig.
+	int candidates;			// Number of seed locations evaluated.
+	double identity;		// Identity percentage of the hit.
+	double coverage;		// Percent of the read covered by the hit.
+};
+
+
+// Interface Prototypes ===========
+
+// Set the alignment scores: match, mismatch, gap open (h), and gap extension (g).
+void mapread_set_scoring (int, int, int, int);
+// Set the minimum identity and coverage percentages for a read to be a hit.
+void mapread_set_thresholds (double, double);
+// Set how many reads of a batch are seeded together, their tree walks interleaved
+// to overlap memory latency (1 to 64, default 32; 1 seeds each read on its own).
+void mapread_set_seed_batch (int);
+// Seed reads that have no exact seed with up to the given number of substitutions and
+// indels (0, the default, to leave them unmapped), taking at most the given number of
+// search steps per read (0 for the default).
+void mapread_set_approx (int, long);
+// Set the index built by later calls (MAPREAD_SEEDS_*) and, for minimizers, the k-mer
+// length, window, and most occurrences of a minimizer still used (0 for each default).
+void mapread_set_seeding (int, int, int, int);
+// Map later batches as long reads (1) of any length, by chaining exact matches and
+// aligning between them, or as short reads (0, the default) cut to 511 bases.
+void mapread_set_long_reads (int);
+// Set the early-exit policy (MAPREAD_EXIT_*) and the hit count MAPREAD_EXIT_TOP waits for.
+void mapread_set_exit_policy (int, int);
+// Build and prepare an index over the given named sequences and alphabet.
+// Characters outside the alphabet are dropped.  Return NULL on failure, or if
+// the sequences are too long for this build (rebuild with make LARGE_GENOME=1).
+struct mapindex *mapread_build_index (const char**, const char**, int, const char*);
+// Build and prepare an index over every record of a FASTA file.  Return NULL
+// on failure, or if the records are too long for this build, as above.
+struct mapindex *mapread_load_index (const char*, const char*);
+// Number of contigs in an index and the name of each.
+int mapread_num_contigs (struct mapindex*);
+const char *mapread_contig_name (struct mapindex*, int);
+// Map a batch of reads, storing one result per read.  Return the number of hits.
+int mapread_map_batch (struct mapindex*, const char**, int, struct mapread_hit*);
+// Cache the results of reads mapped against an index, up to the given number of
+// distinct reads (0 to stop caching), so that repeated reads are mapped once.  Set
+// the scoring, thresholds and exit policy first: cached results do not follow them.
+void mapread_enable_cache (struct mapindex*, int);
+// Move an index onto the given page backing (MAPREAD_PAGES_*) and, if the last
+// argument is nonzero, replicate it on every NUMA node so that each thread maps
+// against the copy nearest it.  Call once, after building.  Return the backing obtained.
+int mapread_place_index (struct mapindex*, int, int);
+// Free an index and everything it owns.
+void mapread_free_index (struct mapindex*);
+
+
+#endif
@@ -9,74 +9,378 @@
 // ============================================================================
 
 double X = 90.0, Y = 80.0;
+int EXIT_POLICY = EXIT_ALL, EXIT_N = 1;
+int SEED_BATCH = 32;
+int APPROX_EDITS = 0;
+long APPROX_BUDGET = DEFAULT_APPROX_BUDGET;
+int SEED_INDEX = SEEDS_TREE, MINIMIZER_K = DEFAULT_MINIMIZER_K, MINIMIZER_W = DEFAULT_MINIMIZER_W;
+int MAX_OCC = DEFAULT_MAX_OCC;
+int LONG_READS = 0;
 
 // ============================================================================
 // Prepare Tree Sequence 
 // ============================================================================
 
 
-int *init_leafarray (int length)
-// Allocate an array size of length and initialize it to hold -1s.
+void init_leafarray (struct packed *leaves, pos_t length)
+// Allocate a leaf array of the given length, packed to the bits its largest
+// suffix number, length - 1, needs.
 {
-	int i, *leaves;
+	init_packed (leaves, length, packed_bits (length - 1));
+}	
 
-	// Allocate array.
-	leaves = (int*) malloc (sizeof (int) * (length));
-	if (!leaves) {
-		perror ("Unable to allocate leaf array");
-		exit (1);
-	}
 
-	// Initialize array to hold all -1s
-	for (i = 0; i < length; ++i) {
-		leaves[i] = -1;
-	}
+pos_t get_leaf (struct mapindex *index, pos_t k)
+// Return the suffix number of the k-th leaf in depth-first order, from the
+// packed leaf array, or a lazy tree's suffix array.
+{
+	if (index -> tree -> suffixes) return index -> tree -> suffixes[k];
+	return packed_get (&index -> leafarray, k);
+}
 
-	return leaves;
-}	
+
+size_t leaf_bytes (struct mapindex *index)
+// Bytes of the index's leaf array, or of a lazy tree's suffix array.
+{
+	if (!index -> tree) return 0;
+	if (index -> tree -> suffixes) return (size_t) (index -> tree -> slen + 1) * sizeof (pos_t);
+	return packed_bytes (&index -> leafarray);
+}
 
 
-void prepare_tree_DFS (struct node *tree)
+void prepare_tree_DFS (struct mapindex *index, struct node *tree)
 // Perform a Depth-First traversal of the given tree, populating
 // the leaf array and marking each internal node's leaf list as the
 // interval [leafarray[node->array_start], leafarray[node->array_end]).
+// The path to the current node is kept on an explicit stack so that deep
+// trees cannot exhaust the call stack.
 {
-	struct node *curr, *rightchild;
-	if (tree) {
-		if (tree -> sfxnum != -1) { 	// leaf case
-			leafarray[nextindex] = tree -> sfxnum;
-			tree -> array_start = nextindex;
-			tree -> array_end = nextindex;
-			++nextindex;
-		} else {						// internal node case
-
-			// Recursively visit all children from left to right.
-			curr = tree -> leftchild;
-			rightchild = curr;
-			while (curr) {
-				prepare_tree_DFS (curr);
-				rightchild = curr;
-				curr = curr -> rightsib;
-			}
+	struct dfs_stack stack;
+	struct node *curr = tree;
+
+	if (!tree) return;
+	init_stack (&stack);
+	for (;;) {
+		if (curr -> sfxnum == -1) {		// internal node case
+			// Its leaf list begins with the next leaf recorded.  Stack it
+			// and descend to its leftmost child.
+			curr -> array_start = index -> nextindex;
+			push_stack (&stack, curr);
+			curr = curr -> leftchild;
+			continue;
+		}
 
-			// Set internal node's leaf list to be the start of its leftmost 
-			// child and the end of its rightmost child.
-			tree -> array_start = tree -> leftchild -> array_start;
-			tree -> array_end = rightchild -> array_end;
+		// leaf case
+		packed_set (&index -> leafarray, index -> nextindex, curr -> sfxnum);
+		curr -> array_start = index -> nextindex;
+		curr -> array_end = index -> nextindex;
+		++index -> nextindex;
+
+		// Close the leaf list of every node whose children are exhausted.
+		while (!curr -> rightsib || curr == tree) {
+			if (!stack.top) {
+				free_stack (&stack);
+				return;
+			}
+			curr = stack.nodes[--stack.top];
+			curr -> array_end = index -> nextindex - 1;
 		}
+		curr = curr -> rightsib;
 	}
 }	
 
 
-void prepare_tree (struct node *tree)
-// Prepare the suffix tree for the read mapping.
+void prepare_tree (struct mapindex *index)
+// Prepare the index's suffix tree, or its read index's, for the read mapping.
+// A minimizer index needs no preparation, and a lazy tree's leaves are read
+// from its suffix array, each node's range of it set as the node is made.
 {
+	if (index -> reads) prepare_tree (index -> reads);
+	if (!index -> tree || index -> tree -> suffixes) return;
+
 	// Allocate an array the length of the input genome
-	leafarray = init_leafarray (slen + 1);
+	init_leafarray (&index -> leafarray, index -> tree -> slen + 1);
 
 	// Perform a depth-first traversal of the tree recording the leaf list
 	// of each node visited, and marking each leaf in the leafarray.
-	prepare_tree_DFS (tree);
+	index -> nextindex = 0;
+	prepare_tree_DFS (index, index -> tree -> root);
+}
+
+
+struct mapindex *new_index (char *genome, char **names, pos_t *starts, int numcontigs)
+// Return an index over the given genome and contig table, as returned by
+// read_fasta_all, with nothing built over it yet.  The index takes ownership
+// of them.
+{
+	struct mapindex *index;
+
+	index = (struct mapindex*) calloc (1, sizeof (struct mapindex));
+	if (!index) {
+		perror ("Unable to allocate index");
+		exit (1);
+	}
+	index -> genome = genome;
+	index -> contignames = names;
+	index -> contigstarts = starts;
+	index -> numcontigs = numcontigs;
+	return index;
+}
+
+
+struct mapindex *build_index (char *genome, char **names, pos_t *starts, 
+								int numcontigs, char *alphabet)
+// Build the suffix tree for the given genome over the given alphabet, or
+// the lazy tree or minimizer index SEED_INDEX asks for, and return an index owning
+// it.  The index takes ownership of the genome and of the contig names and
+// starts, as returned by read_fasta_all.  Exit if the genome is too long
+// for this build's positions.
+{
+	struct mapindex *index;
+
+	check_length (strlen (genome) + 1, "The genome");
+	index = new_index (genome, names, starts, numcontigs);
+
+	if (SEED_INDEX == SEEDS_MINIMIZER) {
+		index -> minimizers = build_minindex (genome, starts[numcontigs] - 1, MINIMIZER_K, MINIMIZER_W);
+	} else if (SEED_INDEX == SEEDS_LAZY) {
+		index -> tree = build_lazy_tree (genome);
+	} else {
+		index -> tree = build_tree (genome, alphabet);
+	}
+	return index;
+}
+
+
+void enable_cache (struct mapindex *index, int entries)
+// Cache the results of reads mapped against the index, so that repeats of a
+// read are answered without seeding or aligning it again.  Results depend on
+// the scoring, thresholds and exit policy, so those should be set first.
+{
+	int k;
+	free_readcache (index -> cache);
+	index -> cache = (entries > 0)? new_readcache (entries) : NULL;
+	for (k = 0; index -> replicas && k < index -> topo -> numnodes; ++k) {
+		index -> replicas[k] -> cache = index -> cache;
+	}
+}
+
+
+void place_copy (struct mapindex *to, struct mapindex *from, int pages)
+// Copy from's tree nodes, leaf array and genome into a single block with the
+// given page backing, owned by to.  Only the idCnt nodes in use are copied,
+// not the whole reserved pool, and the copy's pages land on the NUMA node of
+// the calling thread.
+{
+	struct stree *st = from -> tree;
+	size_t nodebytes = (size_t) st -> idCnt * sizeof (struct node);
+	size_t leafbytes = leaf_bytes (from);
+	char *block;
+
+	to -> placedbytes = nodebytes + leafbytes + st -> slen + 2;
+	to -> placed = block = (char*) alloc_placed (to -> placedbytes, pages, &to -> backing);
+	to -> leafarray = from -> leafarray;
+	to -> leafarray.words = (unsigned long*) (block + nodebytes);
+	to -> genome = block + nodebytes + leafbytes;
+	memcpy (to -> leafarray.words, from -> leafarray.words, leafbytes);
+	memcpy (to -> genome, from -> genome, st -> slen + 2);
+	to -> tree = (struct stree*) malloc (sizeof (struct stree));
+	if (!to -> tree) {
+		perror ("Unable to allocate tree");
+		exit (1);
+	}
+	copy_tree (to -> tree, st, (struct node*) block, to -> genome);
+}
+
+
+void release_storage (struct mapindex *index)
+// Release an index's tree, leaf array and genome, wherever they live.
+{
+	if (index -> placed) {
+		free (index -> tree);
+		free_placed (index -> placed, index -> placedbytes);
+	} else {
+		free_packed (&index -> leafarray);
+		free_tree (index -> tree);
+		free_minindex (index -> minimizers);
+		free (index -> genome);
+	}
+}
+
+
+void place_index (struct mapindex *index, int pages)
+// Move a prepared index's tree nodes, leaf array and genome into one block
+// backed by huge pages (PAGES_THP or PAGES_HUGETLB) or ordinary ones.  The
+// backing obtained is recorded in index -> backing.  A minimizer index is
+// small and is left where it is, as is a lazy tree, which is still growing.
+{
+	struct mapindex placed;
+
+	if (!index -> tree || index -> tree -> suffixes) return;
+	bzero (&placed, sizeof (struct mapindex));
+	place_copy (&placed, index, pages);
+	release_storage (index);
+	index -> tree = placed.tree;
+	index -> leafarray = placed.leafarray;
+	index -> genome = placed.genome;
+	index -> placed = placed.placed;
+	index -> placedbytes = placed.placedbytes;
+	index -> backing = placed.backing;
+}
+
+
+// One replica being built by a thread pinned to its node.
+struct replicajob {
+	struct mapindex *index;		// Index to replicate.
+	int node;					// Node to replicate it on.
+	int pages;					// Page backing for the replica.
+};
+
+
+void *build_replica (void *arg)
+// Pin to the job's node and copy the index there, so first touch puts the
+// replica's pages in that node's memory.
+{
+	struct replicajob *job = (struct replicajob*) arg;
+	struct mapindex *index = job -> index, *replica;
+
+	replica = (struct mapindex*) calloc (1, sizeof (struct mapindex));
+	if (!replica) {
+		perror ("Unable to allocate index replica");
+		exit (1);
+	}
+	pin_to_node (index -> topo, job -> node);
+	place_copy (replica, index, job -> pages);
+
+	// The contig table, read cache and topology are small or shared, so stay with the primary.
+	replica -> topo = index -> topo;
+	replica -> contignames = index -> contignames;
+	replica -> contigstarts = index -> contigstarts;
+	replica -> numcontigs = index -> numcontigs;
+	replica -> cache = index -> cache;
+	replica -> node = job -> node;
+	replica -> primary = index;
+	index -> replicas[job -> node] = replica;
+	return NULL;
+}
+
+
+int replicate_index (struct mapindex *index, int pages)
+// Give each NUMA node its own copy of the index's read-only tree, leaf array
+// and genome.  The index itself serves the node the calling thread is on,
+// where it was built; each other node's copy is made by a thread pinned to
+// that node.  Return the number of nodes, 1 on a machine without NUMA.
+{
+	struct replicajob jobs[MAX_NUMA_NODES];
+	pthread_t threads[MAX_NUMA_NODES];
+	int k;
+
+	if (!index -> tree || index -> tree -> suffixes) return 1;
+	if (index -> replicas) return index -> topo -> numnodes;
+	index -> topo = (struct topology*) malloc (sizeof (struct topology));
+	index -> replicas = (struct mapindex**) calloc (MAX_NUMA_NODES, sizeof (struct mapindex*));
+	if (!index -> topo || !index -> replicas) {
+		perror ("Unable to allocate index replicas");
+		exit (1);
+	}
+	read_topology (index -> topo);
+	index -> node = current_node (index -> topo);
+	index -> replicas[index -> node] = index;
+	for (k = 0; k < index -> topo -> numnodes; ++k) {
+		jobs[k].index = index;
+		jobs[k].node = k;
+		jobs[k].pages = pages;
+		if (k != index -> node && pthread_create (&threads[k], NULL, build_replica, &jobs[k])) {
+			perror ("Unable to start replica thread");
+			exit (1);
+		}
+	}
+	for (k = 0; k < index -> topo -> numnodes; ++k) {
+		if (k != index -> node) pthread_join (threads[k], NULL);
+	}
+	return index -> topo -> numnodes;
+}
+
+
+struct mapindex *nearest_index (struct mapindex *index)
+// Return the replica of the index on the calling thread's NUMA node, or the
+// index itself if it is not replicated.
+{
+	return (index -> replicas)? index -> replicas[current_node (index -> topo)] : index;
+}
+
+
+long index_bytes (struct mapindex *index)
+// Bytes of the index's tree nodes in use, leaf array and genome, or of its
+// minimizer index or read index, and genome.
+{
+	struct stree *st = index -> tree;
+	if (index -> reads) return index_bytes (index -> reads) + index -> contigstarts[index -> numcontigs];
+	if (!st) return minindex_bytes (index -> minimizers) + index -> contigstarts[index -> numcontigs];
+	return (long) st -> idCnt * sizeof (struct node) + leaf_bytes (index) + st -> slen + 2;
+}
+
+
+long index_huge_bytes (struct mapindex *index)
+// Bytes of the index's tree nodes, leaf array and genome backed by huge
+// pages, or -1 if the kernel does not say.  A placed block's last huge page
+// is only partly used, so its count is capped at the index's size.
+{
+	struct stree *st = index -> tree;
+	long nodes, leaves, genome;
+
+	if (index -> placed) {
+		nodes = huge_bytes (index -> placed, index -> placedbytes);
+		return (nodes > index_bytes (index))? index_bytes (index) : nodes;
+	}
+	if (index -> reads) {
+		nodes = index_huge_bytes (index -> reads);
+		genome = huge_bytes (index -> genome, index -> contigstarts[index -> numcontigs]);
+		return (nodes < 0 || genome < 0)? -1 : nodes + genome;
+	}
+	if (!st) {
+		nodes = huge_bytes (index -> minimizers -> table,
+							index -> minimizers -> tablesize * sizeof (struct minslot));
+		leaves = huge_bytes (index -> minimizers -> positions,
+							index -> minimizers -> numpositions * sizeof (pos_t));
+		genome = huge_bytes (index -> genome, index -> contigstarts[index -> numcontigs]);
+		return (nodes < 0 || leaves < 0 || genome < 0)? -1 : nodes + leaves + genome;
+	}
+	nodes = huge_bytes (st -> nodepool, (size_t) st -> idCnt * sizeof (struct node));
+	leaves = huge_bytes ((st -> suffixes)? (void*) st -> suffixes : (void*) index -> leafarray.words,
+						leaf_bytes (index));
+	genome = huge_bytes (index -> genome, st -> slen + 2);
+	return (nodes < 0 || leaves < 0 || genome < 0)? -1 : nodes + leaves + genome;
+}
+
+
+void free_index (struct mapindex *index)
+// Deallocate an index along with its tree, leaf array, genome, cache, read
+// index and replicas.  A replica only owns its own copy of the tree, leaf array and genome.
+{
+	int k;
+	if (index) {
+		release_storage (index);
+		if (index -> primary) {
+			free (index);
+			return;
+		}
+		if (index -> replicas) {
+			for (k = 0; k < index -> topo -> numnodes; ++k) {
+				if (index -> replicas[k] != index) free_index (index -> replicas[k]);
+			}
+			free (index -> replicas);
+			free (index -> topo);
+		}
+		free_readcache (index -> cache);
+		free_index (index -> reads);
+		for (k = 0; k < index -> numcontigs; ++k) {
+			free (index -> contignames[k]);
+		}
+		free (index -> contignames);
+		free (index -> contigstarts);
+		free (index);
+	}
 }
 
 
@@ -88,14 +392,20 @@ void prepare_tree (struct node *tree)
 
 
 
-struct node *find_loc_BF (int len, struct node *tree, char *read, int *maxmatches)
+struct node *find_loc_BF (struct mapindex *index, int len, char *read, int *maxmatches,
+							int *seedpos, struct seedwork *work)
 // Find the location of the longest common substring between an input read and the genome
-// represented by the given suffix tree.
+// represented by the given suffix tree, and the read position it starts at.  Record the
+// work done in work, if given.
 // NOTE: This is the brute force version of the find_loc algorithm.  Start at root for each
 // suffix of the read and match it down the tree.
 {
-	struct node *curr, *parent, *deepest;
-	int matches, readi, readlen, i;
+	struct stree *st = index -> tree;
+	struct node *curr, *parent, *deepest, *tree = st -> root;
+	char *input_string = st -> input_string, *start = read;
+	int matches, readi, readlen;
+	pos_t i;
+	long nodes = 0, edges = 0;
 
 	readlen = len - LAMBDA + 1;	// No need to continue once strlen < LAMBDA
 	curr = tree;
@@ -103,20 +413,23 @@ struct node *find_loc_BF (int len, struct node *tree, char *read, int *maxmatche
 	deepest = tree;
 	matches = 0;
 	*maxmatches = 0;
+	*seedpos = 0;
 
 	// Iterate over the read matching its suffices against the tree.
 	while (*read && readlen) {
 		readi = 0;
-		curr = get_branch_by_match (read[readi], tree);
+		curr = get_branch_count (st, read[readi], tree, &edges);
 		if (curr) {
+			++nodes;
 			// start matching
 			i = curr -> starti;
 			while (input_string[i] == read[readi]) {
 				++matches;
 				if (i + 1 == curr -> endi) {
 					parent = curr;
-					if ((curr = get_branch_by_match (read[++readi], curr)) == NULL) break;
+					if ((curr = get_branch_count (st, read[++readi], curr, &edges)) == NULL) break;
 					i = curr -> starti;
+					++nodes;
 				} else {
 					++i; ++readi;
 				}
@@ -124,34 +437,47 @@ struct node *find_loc_BF (int len, struct node *tree, char *read, int *maxmatche
 			// Exiting loop means a mismatch was seen.
 			if (matches > LAMBDA && matches > *maxmatches) {
 				*maxmatches = matches;
+				*seedpos = read - start;
 				deepest = parent;
 			}
 		}
 		++read; --readlen; matches = 0;
 	}
+	if (work) {
+		work -> nodes = nodes;
+		work -> edges = edges;
+	}
 	return deepest;
 }
 
 
 
-struct node *find_loc (int len, struct node *tree, char *read, int *maxmatches)
+struct node *find_loc (struct mapindex *index, int len, char *read, int *maxmatches,
+						int *seedpos, struct seedwork *work)
 // Find the location of the longest common substring between an input read and the genome
-// represented by the given suffix tree.
+// represented by the given suffix tree, and the read position it starts at.  Record the
+// work done in work, if given.
 // NOTE: This is the optimized version of the find_loc algorithm.
 {
-	struct node *deepest, *curr, *parent;
-	int readi = 0, i, r, e, mismatch = 1;
+	long nodes = 0, edges = 0;
+	struct stree *st = index -> tree;
+	struct node *deepest, *curr, *parent, *tree = st -> root;
+	char *input_string = st -> input_string;
+	int readi = 0, r, mismatch = 1;
+	pos_t i;
 	int readlen = len - LAMBDA + 1;
 
 	*maxmatches = 0;
+	*seedpos = 0;
 	parent = tree;
 	deepest = tree;
 	curr = tree;
 
 	while (read[readi] && readi < readlen) {
 		parent = curr;
-		curr = get_branch_by_match (read[readi], parent);
+		curr = get_branch_count (st, read[readi], parent, &edges);
 		if (curr) {
+			++nodes;
 			r = 0;
 			i = curr -> starti;
 			while (read[readi] == input_string[i]) {
@@ -166,6 +492,7 @@ struct node *find_loc (int len, struct node *tree, char *read, int *maxmatches)
 				if (parent -> strdepth + r > *maxmatches) {
 					deepest = parent;
 					*maxmatches = parent -> strdepth + r;
+					*seedpos = readi - parent -> strdepth;
 				}
 				curr = parent -> sfxlink;
 			} else {
@@ -175,93 +502,1620 @@ struct node *find_loc (int len, struct node *tree, char *read, int *maxmatches)
 			curr = parent -> sfxlink;
 		}
 	}
+	if (work) {
+		work -> nodes = nodes;
+		work -> edges = edges;
+	}
 	return deepest;
 }
 
 
-char *retrieve_substring (int *len, int start, int end) 
-// Retrieve the substring of the input genome[start: end]
+// ============================================================================
+// Batched seeding
+// ============================================================================
+
+// find_loc_batch walks a group of reads down the tree together.  Each read's
+// search is a state machine that stops wherever find_loc_BF would load a node
+// it has not touched yet: it prefetches the node and yields to the next
+// read, so the loads of the whole group are in flight at once.
+
+#define SEED_BRANCH			0	// Comparing the next child against the branch character.
+#define SEED_DONE			1	// Every suffix of the read has been matched.
+
+// Where one read's search stands.
+struct seedstate {
+	char *read;				// Start of the read.
+	char *suffix;			// Suffix of the read being matched from the root.
+	int left;				// Suffixes left to match, as readlen in find_loc_BF.
+	int readi;				// Position in the suffix.
+	int matches;			// Characters of the suffix matched so far.
+	char c;					// Character the current branch is chosen by.
+	int state;
+	struct node *curr;		// Child being compared.
+	struct node *parent;	// Last node whose edge was matched to its end.
+	struct seed *seed;		// Where to store the longest seed found.
+	struct seedwork *work;	// Where to count the nodes visited and edges compared.
+};
+
+
+void prefetch_node (struct node *node)
+// Ask for a node's cache lines ahead of use; a node may straddle two.
 {
-	int i;
-	char *cp;
-	
-	if (start < 0) start = 0;
-	if (end > slen) end = slen;
+	__builtin_prefetch (node);
+	__builtin_prefetch ((char*) (node + 1) - 1);
+}
+
+
+void seed_begin_branch (struct stree *st, struct seedstate *s, struct node *node, char c)
+// Start choosing the child of node whose edge begins with c.
+{
+	s -> c = c;
+	s -> curr = first_child (st, node);
+	if (s -> curr) prefetch_node (s -> curr);
+}
+
+
+void seed_next_suffix (struct stree *st, struct seedstate *s, int first)
+// Record the match of the current suffix if it is the longest so far, then
+// move on to the next suffix, or finish.
+{
+	if (!first) {
+		if (s -> matches > LAMBDA && s -> matches > s -> seed -> matches) {
+			s -> seed -> matches = s -> matches;
+			s -> seed -> pos = s -> suffix - s -> read;
+			s -> seed -> deepest = s -> parent;
+		}
+		++s -> suffix; --s -> left;
+	}
+	s -> matches = 0;
+	s -> readi = 0;
+	if (!*s -> suffix || !s -> left) {
+		s -> state = SEED_DONE;
+	} else {
+		seed_begin_branch (st, s, st -> root, s -> suffix[0]);
+	}
+}
+
+
+void seed_step (struct stree *st, struct seedstate *s)
+// Advance a read's search up to its next node load.
+{
+	char *input_string = st -> input_string;
+	pos_t i;
+
+	while (s -> curr) {
+		// Compare the child, which was prefetched, against the branch character.
+		++s -> work -> edges;
+		if (s -> c != input_string[s -> curr -> starti]) {
+			s -> curr = s -> curr -> rightsib;
+			if (s -> curr) prefetch_node (s -> curr);
+			return;
+		}
+
+		// Match along the child's edge.
+		++s -> work -> nodes;
+		i = s -> curr -> starti;
+		while (input_string[i] == s -> suffix[s -> readi]) {
+			++s -> matches;
+			if (i + 1 == s -> curr -> endi) {
+				s -> parent = s -> curr;
+				seed_begin_branch (st, s, s -> curr, s -> suffix[++s -> readi]);
+				return;
+			}
+			++i; ++s -> readi;
+		}
+		break;
+	}
+	// A mismatch, or no child to branch to, ends the suffix.
+	seed_next_suffix (st, s, 0);
+}
+
+
+void find_loc_batch (struct mapindex *index, int numreads, char **reads, struct seed *seeds,
+						struct seedwork *work)
+// Find the longest seed of each of up to SEED_BATCH_MAX reads, with exactly
+// the results and work counts of find_loc_BF, by advancing the reads' searches
+// in round-robin so that their node loads overlap.
+{
+	struct seedstate states[SEED_BATCH_MAX], *active[SEED_BATCH_MAX];
+	struct stree *st = index -> tree;
+	int k, live = 0;
+
+	for (k = 0; k < numreads && k < SEED_BATCH_MAX; ++k) {
+		states[k].read = states[k].suffix = reads[k];
+		states[k].left = strlen (reads[k]) - LAMBDA + 1;
+		states[k].parent = st -> root;
+		states[k].state = SEED_BRANCH;
+		states[k].seed = &seeds[k];
+		states[k].work = &work[k];
+		seeds[k].deepest = st -> root;
+		seeds[k].matches = seeds[k].pos = 0;
+		seeds[k].locs = NULL;
+		seeds[k].locpos = NULL;
+		work[k].nodes = work[k].edges = 0;
+		seed_next_suffix (st, &states[k], 1);
+		if (states[k].state != SEED_DONE) active[live++] = &states[k];
+	}
+
+	// Step each live search in turn, dropping those that finish.
+	while (live) {
+		for (k = 0; k < live; ) {
+			seed_step (st, active[k]);
+			if (active[k] -> state == SEED_DONE) {
+				active[k] = active[--live];
+			} else {
+				++k;
+			}
+		}
+	}
+}
+
+
+// ============================================================================
+// Approximate seeding
+// ============================================================================
+
+// find_loc_approx backtracks through the tree from each read position in
+// turn, allowing up to APPROX_EDITS substitutions and indels, to find the
+// longest stretch of the read that matches the genome that closely.  The
+// search is depth first and tries the exact path before spending an edit.
+// It is repeated allowing one edit, then two, up to APPROX_EDITS, so that
+// the cheap passes find a long seed for the costly ones to beat.  A path is
+// abandoned once the edits it has spent, plus a lower bound on those the
+// rest of the read needs to beat the best seed, exceed the pass's, and the
+// search is cut off once it has taken APPROX_BUDGET steps.
+
+// One read's approximate search.
+struct approxsearch {
+	struct stree *st;
+	char *read;
+	int readlen;
+	int start;				// Read position the current path starts at.
+	int maxedits;			// Edits allowed in this pass.
+	long steps;				// Steps taken so far, against APPROX_BUDGET.
+	struct seed best;		// Longest approximate seed found.
+	int bestedits;			// Edits in it.
+	int *reach;				// Longest exact match in the genome from each read position.
+	struct seedwork *work;	// Where to count the nodes visited and edges compared.
+};
+
+
+int approx_reach (struct approxsearch *a, int readi)
+// Return the length of the longest prefix of the read from readi that
+// occurs exactly in the genome.
+{
+	char *input_string = a -> st -> input_string;
+	struct node *node = a -> st -> root;
+	int matches = 0;
+	pos_t i;
+
+	while (readi + matches < a -> readlen
+			&& (node = get_branch_count (a -> st, a -> read[readi + matches], node,
+										&a -> work -> edges))) {
+		++a -> work -> nodes;
+		for (i = node -> starti; i < node -> endi && readi + matches < a -> readlen
+								&& input_string[i] == a -> read[readi + matches]; ++i) {
+			++matches;
+		}
+		if (i < node -> endi) break;
+	}
+	return matches;
+}
+
+
+int approx_bound (struct approxsearch *a, int readi)
+// Return a lower bound on the edits any path from readi needs to cover the
+// read far enough to beat the best seed: cut the read greedily into pieces
+// that each end one past their longest exact match, as BWA's backtracking
+// does, since every such piece holds at least one edit.
+{
+	int need = (a -> best.matches > LAMBDA)? a -> best.matches : LAMBDA + 1;
+	int target = a -> start + need, bound = 0;
+
+	if (target > a -> readlen) return a -> maxedits + 1;
+	while (readi < target && readi + a -> reach[readi] < target) {
+		readi += a -> reach[readi] + 1;
+		++bound;
+	}
+	return bound;
+}
+
+
+void approx_record (struct approxsearch *a, struct node *node, int readi, int edits)
+// A path ending in a match has covered the read up to readi on node's edge;
+// keep it if it is the longest, then least edited, seed so far.  Every leaf
+// below node shares the path, so node's leaves are the seed's locations.
+{
+	int len = readi - a -> start;
+	if (len > LAMBDA && (len > a -> best.matches
+						|| (len == a -> best.matches && edits < a -> bestedits))) {
+		a -> best.matches = len;
+		a -> best.pos = a -> start;
+		a -> best.deepest = node;
+		a -> bestedits = edits;
+	}
+}
+
+
+void approx_extend (struct approxsearch *a, struct node *node, pos_t i, int readi, int edits)
+// Extend a path that has reached genome character i on node's edge (or its
+// end, at node -> endi) and read position readi with the given edits.  The
+// path follows the read exactly for as long as it can.  Along an edge it
+// branches on a substitution, an insertion (a read character skipped) or a
+// deletion (a genome character skipped) only where the read stops matching.
+// At a node it also does so after the exact child, since near the root a
+// read error still matches some child and would otherwise never be edited.
+// A read character is skipped at a node's end rather than at the start of
+// each child's edge, so that no alignment is walked twice.  Recursion is
+// bounded by the read length plus the pass's edits.
+{
+	char *input_string = a -> st -> input_string, g;
+	struct node *child, *exact;
+
+	if (a -> steps++ >= APPROX_BUDGET || readi >= a -> readlen
+			|| edits + approx_bound (a, readi) > a -> maxedits) {
+		return;
+	}
+	if (i == node -> endi) {
+		// At a node: take the child the read continues into, if there is one,
+		// then skip the read character, or its genome character, or enter the
+		// other children, whose first characters are substitutions.
+		exact = get_branch_count (a -> st, a -> read[readi], node, &a -> work -> edges);
+		if (exact) {
+			++a -> work -> nodes;
+			approx_extend (a, exact, exact -> starti, readi, edits);
+		}
+		if (edits < a -> maxedits) {
+			approx_extend (a, node, i, readi + 1, edits + 1);
+			if (exact) approx_extend (a, exact, exact -> starti + 1, readi, edits + 1);
+			for (child = first_child (a -> st, node); child; child = child -> rightsib) {
+				if (child == exact) continue;
+				++a -> work -> nodes;
+				approx_extend (a, child, child -> starti, readi, edits);
+			}
+		}
+		return;
+	}
+	g = input_string[i];
+	if (g == '$' || g == SEPARATOR) return;
+	if (g == a -> read[readi]) {
+		approx_record (a, node, readi + 1, edits);
+		approx_extend (a, node, i + 1, readi + 1, edits);
+	} else if (edits < a -> maxedits) {
+		approx_extend (a, node, i + 1, readi + 1, edits + 1);
+		if (i > node -> starti) approx_extend (a, node, i, readi + 1, edits + 1);
+		approx_extend (a, node, i + 1, readi, edits + 1);
+	}
+}
+
+
+struct node *find_loc_approx (struct mapindex *index, int len, char *read, int *maxmatches,
+								int *seedpos, struct seedwork *work)
+// Find the longest stretch of the read that matches the genome with at most
+// APPROX_EDITS substitutions and indels, and the read position it starts at,
+// for reads whose errors are too close together for an exact seed longer
+// than LAMBDA.  Each path starts with an exact character, so the seed's
+// locations are where its first base lies; any indels shift the rest by at
+// most APPROX_EDITS, well within the alignment window.  Start positions that
+// cannot beat the best seed so far are skipped.  Record the work done in
+// work, if given.  Return the root, with maxmatches 0, if there is no seed.
+{
+	struct stree *st = index -> tree;
+	struct seedwork counts = { 0, 0 };
+	struct approxsearch a;
+	struct node *child;
+	int reach[READ_LENGTH], k;
+
+	a.st = st;
+	a.read = read;
+	a.readlen = len;
+	a.steps = 0;
+	a.best.deepest = st -> root;
+	a.best.matches = a.best.pos = 0;
+	a.bestedits = APPROX_EDITS + 1;
+	a.reach = reach;
+	a.work = &counts;
+	for (k = 0; k < len; ++k) {
+		reach[k] = approx_reach (&a, k);
+	}
+	for (a.maxedits = 1; a.maxedits <= APPROX_EDITS; ++a.maxedits) {
+		for (a.start = 0; len - a.start > a.best.matches && len - a.start > LAMBDA
+							&& a.steps < APPROX_BUDGET; ++a.start) {
+			child = get_branch_count (st, read[a.start], st -> root, &counts.edges);
+			if (child) {
+				++counts.nodes;
+				approx_extend (&a, child, child -> starti + 1, a.start + 1, 0);
+			}
+		}
+	}
+	*maxmatches = a.best.matches;
+	*seedpos = a.best.pos;
+	if (work) *work = counts;
+	return a.best.deepest;
+}
+
+
+void seed_approx (struct mapindex *index, char *read, struct seed *seed, struct hit *hit)
+// Seed a read approximately if it has no exact seed and APPROX_EDITS allows
+// it, adding the work and time to the read's.
+{
+	struct seedwork work;
+	long start;
+
+	if (seed -> matches > LAMBDA || APPROX_EDITS <= 0 || !index -> tree) return;
+	start = now_ns ();
+	seed -> deepest = find_loc_approx (index, strlen (read), read, &seed -> matches,
+										&seed -> pos, &work);
+	hit -> seed.nodes += work.nodes;
+	hit -> seed.edges += work.edges;
+	hit -> approx = 1 + (seed -> matches > LAMBDA);
+	hit -> seedns += now_ns () - start;
+}
+
+
+int find_contig (struct mapindex *index, pos_t pos)
+// Return the contig holding the given genome position by binary search
+// over the contig boundary table.
+{
+	int lo = 0, hi = index -> numcontigs - 1, mid;
+	while (lo < hi) {
+		mid = (lo + hi + 1) / 2;
+		if (index -> contigstarts[mid] <= pos) {
+			lo = mid;
+		} else {
+			hi = mid - 1;
+		}
+	}
+	return lo;
+}
+
+
+char *retrieve_substring (struct mapindex *index, int *len, int contig, pos_t start, pos_t end) 
+// Retrieve the substring of the input genome[start: end], clipped to the
+// bounds of the given contig.
+{
+	pos_t cstart = index -> contigstarts[contig];
+	pos_t cend = index -> contigstarts[contig + 1] - 1;
+	if (start < cstart) start = cstart;
+	if (end > cend) end = cend;
 	*len = end - start;
-	return &input_string[start];
+	return &index -> genome[start];
+}
+
+
+int gap_margin (int readlen)
+// Return the most gaps an alignment of a read of the given length can hold
+// and still reach the identity threshold.  Each gap column costs a match, so
+// g gaps need g <= (readlen + g) * (1 - X/100), capped at the read length.
+{
+	double margin;
+	if (X <= 0.0) return readlen;
+	margin = readlen * (100.0 - X) / X + 1.0;
+	return (margin < readlen)? (int) margin : readlen;
+}
+
+
+// ============================================================================
+// Minimizer seeding
+// ============================================================================
+
+// A minimizer shared by the read and the genome.
+struct anchor {
+	pos_t diag;				// Genome position the anchor puts the read's start at.
+	pos_t pos;				// Genome position of the minimizer.
+	int readpos;			// Read position of the minimizer.
+};
+
+// A run of anchors on nearby diagonals: one candidate location.
+struct cluster {
+	int first;				// First of its anchors, sorted by diagonal.
+	int count;				// Number of anchors.
+};
+
+
+int compare_anchors (const void *a, const void *b)
+// Order anchors by diagonal, then read position.
+{
+	const struct anchor *x = (const struct anchor*) a, *y = (const struct anchor*) b;
+	if (x -> diag != y -> diag) return (x -> diag < y -> diag)? -1 : 1;
+	return x -> readpos - y -> readpos;
+}
+
+
+int compare_clusters (const void *a, const void *b)
+// Order clusters by anchors, most first, then by diagonal.
+{
+	const struct cluster *x = (const struct cluster*) a, *y = (const struct cluster*) b;
+	if (x -> count != y -> count) return y -> count - x -> count;
+	return x -> first - y -> first;
+}
+
+
+void find_loc_minimizers (struct mapindex *index, char *read, struct seed *seed, struct hit *hit)
+// Find the read's candidate locations from the minimizers it shares with the
+// genome.  Minimizers occurring more than MAX_OCC times are skipped as
+// repeats.  Anchors whose diagonals lie within the alignment margin of each
+// other are one location, and locations with at least half the anchors of
+// the best are kept, most anchored first.  Each is given to align_seed as
+// the genome and read positions of its median anchor, which the ungapped
+// extension starts from.  seed -> locs and seed -> locpos share one block,
+// freed with seed -> locs.
+{
+	struct minimizer *mins = NULL;
+	struct anchor *anchors = NULL;
+	struct cluster *clusters;
+	int n, j, k, numanchors = 0, numclusters = 0, best = 0, mid;
+	long cap = 0, count;
+	pos_t *positions;
+	int readlen = strlen (read), margin = gap_margin (readlen);
+
+	seed -> deepest = NULL;
+	seed -> matches = seed -> pos = 0;
+	seed -> locs = NULL;
+	seed -> locpos = NULL;
+	seed -> numlocs = 0;
+
+	// Gather the anchors.
+	n = find_minimizers (read, readlen, MINIMIZER_K, MINIMIZER_W, &mins, &cap);
+	for (j = 0; j < n; ++j) {
+		positions = lookup_minimizer (index -> minimizers, mins[j].hash, &count);
+		if (count > MAX_OCC) {
+			++hit -> filtered;
+			continue;
+		}
+		anchors = (struct anchor*) realloc (anchors, sizeof (struct anchor) * (numanchors + count + 1));
+		if (!anchors) {
+			perror ("Unable to allocate anchors");
+			exit (1);
+		}
+		for (k = 0; k < count; ++k, ++numanchors) {
+			anchors[numanchors].diag = positions[k] - mins[j].pos;
+			anchors[numanchors].pos = positions[k];
+			anchors[numanchors].readpos = mins[j].pos;
+		}
+	}
+	free (mins);
+	hit -> anchors = numanchors;
+	hit -> seed.nodes += n;
+	if (!numanchors) {
+		free (anchors);
+		return;
+	}
+
+	// Cluster them by diagonal.
+	qsort (anchors, numanchors, sizeof (struct anchor), compare_anchors);
+	clusters = (struct cluster*) malloc (sizeof (struct cluster) * numanchors);
+	if (!clusters) {
+		perror ("Unable to allocate clusters");
+		exit (1);
+	}
+	for (j = 0; j < numanchors; j += clusters[numclusters++].count) {
+		clusters[numclusters].first = j;
+		for (k = j + 1; k < numanchors && anchors[k].diag - anchors[j].diag <= margin; ++k);
+		clusters[numclusters].count = k - j;
+		if (k - j > best) best = k - j;
+	}
+	qsort (clusters, numclusters, sizeof (struct cluster), compare_clusters);
+	while (numclusters > 1 && 2 * clusters[numclusters - 1].count < best) --numclusters;
+
+	// Hand each location over as its median anchor.
+	seed -> locs = (pos_t*) malloc ((sizeof (pos_t) + sizeof (int)) * numclusters);
+	if (!seed -> locs) {
+		perror ("Unable to allocate locations");
+		exit (1);
+	}
+	seed -> locpos = (int*) (seed -> locs + numclusters);
+	seed -> numlocs = numclusters;
+	seed -> matches = best * MINIMIZER_K;
+	for (j = 0; j < numclusters; ++j) {
+		mid = clusters[j].first + clusters[j].count / 2;
+		seed -> locs[j] = anchors[mid].pos;
+		seed -> locpos[j] = anchors[mid].readpos;
+	}
+	free (clusters);
+	free (anchors);
+}
+
+
+// A seed location left for full alignment, and how promising its diagonal looked.
+struct candidate {
+	pos_t leaf;				// Genome position of the seed.
+	int seedpos;			// Read position of the seed.
+	int score;				// Score of the ungapped extension along its diagonal.
+	int order;				// Position in the leaf array, to break ties.
+};
+
+#define CANDIDATE_STACK		64		// Candidates a read can hold without allocating.
+
+
+int set_exit_policy (const char *name)
+// Set the early-exit policy from its name: all, first, best, or top<N>.
+// Return 1 if it was set, 0 if the name is not recognised.
+{
+	int n;
+	if (strcmp (name, "all") == 0) {
+		EXIT_POLICY = EXIT_ALL;
+	} else if (strcmp (name, "first") == 0) {
+		EXIT_POLICY = EXIT_FIRST;
+	} else if (strcmp (name, "best") == 0) {
+		EXIT_POLICY = EXIT_BEST;
+	} else if (sscanf (name, "top%d", &n) == 1 && n > 0) {
+		EXIT_POLICY = EXIT_TOP;
+		EXIT_N = n;
+	} else {
+		return 0;
+	}
+	return 1;
+}
+
+
+int exit_reached (int passed, int perfect)
+// Return 1 if the exit policy lets a read stop, given the number of its
+// candidates that were hits and whether one of them was perfect.
+{
+	switch (EXIT_POLICY) {
+		case EXIT_FIRST: return passed >= 1;
+		case EXIT_BEST: return perfect;
+		case EXIT_TOP: return passed >= EXIT_N;
+	}
+	return 0;
+}
+
+
+int compare_candidates (const void *a, const void *b)
+// Order candidates by descending ungapped score, then by leaf array position.
+{
+	const struct candidate *ca = (const struct candidate*) a, *cb = (const struct candidate*) b;
+	if (ca -> score != cb -> score) return (ca -> score > cb -> score)? -1 : 1;
+	return ca -> order - cb -> order;
 }
 
 
-void map_reads (struct node *tree, const char *readfile, const char *writefile)
-// Map the reads one-by-one onto the genome.
+int record_hit (struct mapindex *index, struct hit *hit, int contig, pos_t start, pos_t end,
+				int *matchalign, int readlen, int fast)
+// Record a candidate's alignment, which covers genome[start: end], as the
+// read's hit if it passes the thresholds and beats the best so far on
+// coverage, then identity.  Return 1 if it passes.
 {
-	char read[READ_LENGTH], readname[NAME_LENGTH], *gslice;
-	int i = 0, j, readlen, score, comp, matchalign[2], slicelen, avg;
-	int hitstart, hitend, matches, hits = 0, nohits = 0, numleaves = 0;
-	double identity, coverage, maxcoverage = 0.0;
+	double identity = ((double) matchalign[1] / (double) matchalign[0]) * 100.0;
+	double coverage = ((double) matchalign[0] / (double) readlen) * 100.0;
+
+	if (!(identity >= X && coverage >= Y)) return 0;
+	if (coverage > hit -> coverage || (coverage == hit -> coverage && identity > hit -> identity)) {
+		hit -> coverage = coverage;
+		hit -> identity = identity;
+		hit -> contig = contig;
+		hit -> fast = fast;
+		hit -> start = start - index -> contigstarts[contig];
+		hit -> end = end - index -> contigstarts[contig];
+	}
+	return 1;
+}
+
+
+void clear_hit (struct hit *hit)
+// Reset a read's hit before mapping it.
+{
+	hit -> contig = -1;
+	hit -> coverage = hit -> identity = 0.0;
+	hit -> locations = 0;
+	hit -> candidates = 0;
+	hit -> ungapped = 0;
+	hit -> fast = 0;
+	hit -> cached = 0;
+	hit -> approx = 0;
+	hit -> anchors = hit -> filtered = 0;
+	hit -> seed.nodes = hit -> seed.edges = 0;
+	hit -> align.cells = hit -> align.tracesteps = 0;
+	hit -> seedns = hit -> alignns = 0;
+}
+
+
+int lookup_read (struct mapindex *index, char *read, struct hit *hit)
+// Clear a read's hit and, if the index caches results, look the read up.
+// Return 1 if the read was answered from the cache.
+{
+	struct cachedhit cached;
+
+	clear_hit (hit);
+
+	// Reads are mapped as given, so all are cached as forward ('+').
+	if (index -> cache && cache_lookup (index -> cache, read, '+', &cached)) {
+		hit -> cached = 1;
+		hit -> contig = cached.contig;
+		hit -> start = cached.start;
+		hit -> end = cached.end;
+		hit -> identity = cached.identity;
+		hit -> coverage = cached.coverage;
+		return 1;
+	}
+	return 0;
+}
+
+
+void align_seed (struct mapindex *index, char *read, struct seed *seed, DPTABLE *table,
+					struct hit *hit)
+// Evaluate the locations a read's seed occurs at, keeping the hit with the
+// best coverage.  Every location is first tried with an ungapped extension
+// along the seed's diagonal, which resolves most of them; the rest are
+// aligned in full, best ungapped score first, over a window centred on
+// where the seed puts the read's start.  Evaluation stops as soon as the
+// exit policy allows.  The outcome is added to the index's cache, if any.
+// The locations are the leaves of a tree seed's deepest node, or a minimizer
+// seed's anchors, each with its own read position.
+{
+	struct candidate stackcands[CANDIDATE_STACK], *cands = stackcands;
+	struct node *deepest = seed -> deepest;
+	struct cachedhit cached;
+	char *gslice;
+	int j, k, readlen, matchalign[2], span[2], slicelen, contig, seedpos = seed -> pos, score;
+	int margin, pending = 0, passed = 0, perfect = 0;
+	pos_t loc, readstart, cstart, first = 0;
+	WORK work;
+
+	hit -> alignns = now_ns ();
+	readlen = strlen (read);
+	if (seed -> locs) {
+		hit -> locations = seed -> numlocs;
+	} else if (seed -> matches > LAMBDA) {
+		expand_subtree (index -> tree, deepest);
+		first = deepest -> array_start;
+		hit -> locations = deepest -> array_end - deepest -> array_start + 1;
+	}
+	if (hit -> locations) { 
+		// The read's query profile is reused for every location.
+		set_query (table, read);
+		margin = gap_margin (readlen);
+		if (hit -> locations > CANDIDATE_STACK) {
+			cands = (struct candidate*) malloc (sizeof (struct candidate) * hit -> locations);
+			if (!cands) {
+				perror ("Unable to allocate candidates");
+				exit (1);
+			}
+		}
+
+		// Try each location's diagonal without gaps, setting aside those that
+		// fall short of the thresholds.
+		for (j = 0; j < hit -> locations; ++j) {
+			if (exit_reached (passed, perfect)) break;
+			hit -> candidates++;
+			if (seed -> locpos) seedpos = seed -> locpos[j];
+			loc = (seed -> locs)? seed -> locs[j] : get_leaf (index, first + j);
+			contig = find_contig (index, loc);
+			readstart = loc - seedpos;
+
+			// The extension works in offsets within the contig, which fit an int.
+			cstart = index -> contigstarts[contig];
+			score = extend_ungapped (read, readlen, index -> genome + cstart, 0,
+									index -> contigstarts[contig + 1] - 1 - cstart,
+									readstart - cstart, seedpos, matchalign, span);
+			if (record_hit (index, hit, contig, readstart + span[0], readstart + span[1],
+							matchalign, readlen, 1)) {
+				hit -> ungapped++;
+				passed++;
+				perfect |= matchalign[0] == readlen && matchalign[1] == readlen;
+			} else {
+				cands[pending].leaf = loc;
+				cands[pending].seedpos = seedpos;
+				cands[pending].score = score;
+				cands[pending].order = pending;
+				pending++;
+			}
+		}
+
+		// Align the rest in full, most promising first, between the read
+		// and the genome slice it can reach within the gaps the thresholds
+		// allow.
+		qsort (cands, pending, sizeof (struct candidate), compare_candidates);
+		for (k = 0; k < pending; ++k) {
+			if (exit_reached (passed, perfect)) break;
+			contig = find_contig (index, cands[k].leaf);
+			readstart = cands[k].leaf - cands[k].seedpos;
+			gslice = retrieve_substring (index, &slicelen, contig, readstart - margin,
+										readstart + readlen + margin);
+			align_query (gslice, slicelen, matchalign, span, table, &work);
+			hit -> align.cells += work.cells;
+			hit -> align.tracesteps += work.tracesteps;
+			if (record_hit (index, hit, contig, gslice - index -> genome + span[0],
+							gslice - index -> genome + span[1], matchalign, readlen, 0)) {
+				passed++;
+				perfect |= matchalign[0] == readlen && matchalign[1] == readlen;
+			}
+		}
+		if (cands != stackcands) free (cands);
+	}
+	if (index -> cache) {
+		cached.contig = hit -> contig;
+		cached.start = hit -> start;
+		cached.end = hit -> end;
+		cached.identity = hit -> identity;
+		cached.coverage = hit -> coverage;
+		cache_store (index -> cache, read, '+', &cached);
+	}
+	hit -> alignns = now_ns () - hit -> alignns;
+}
+
+
+int map_read (struct mapindex *index, char *read, DPTABLE *table, struct hit *hit)
+// Map a single read onto the genome: find its longest exact seed in the
+// suffix tree, or its minimizer anchors, and evaluate the locations the seed
+// occurs at, as align_seed describes.  The hit's start and end are those of
+// the alignment itself.  If the index caches results, a read seen before is
+// answered from the cache.  Return 1 if the read was a hit, 0 if not.
+{
+	struct seed seed;
+	long start = now_ns ();
+
+	if (!lookup_read (index, read, hit)) {
+		if (index -> minimizers) {
+			find_loc_minimizers (index, read, &seed, hit);
+		} else {
+			seed.locs = NULL;
+			seed.locpos = NULL;
+			seed.deepest = find_loc_BF (index, strlen (read), read, &seed.matches, &seed.pos,
+										&hit -> seed);
+		}
+		hit -> seedns = now_ns () - start;
+		seed_approx (index, read, &seed, hit);
+		align_seed (index, read, &seed, table, hit);
+		free (seed.locs);
+	} else {
+		hit -> seedns = now_ns () - start;
+	}
+	return hit -> contig >= 0;
+}
+
+
+int map_batch (struct mapindex *index, int numreads, char **reads, DPTABLE *table,
+				struct hit *hits)
+// Map a batch of reads onto the genome, storing each read's hit in the
+// matching slot of hits, with the same results as map_read.  With a
+// SEED_BATCH above 1, the reads not answered from the cache are seeded
+// together by find_loc_batch, SEED_BATCH at a time.  Each is charged the
+// share of the time that took that its nodes visited and edges compared are
+// of the batch's, so that a read with pathological seeding still stands out
+// in the latency histogram and to --slow.  Return the number of reads that hit.
+{
+	struct seed seeds[SEED_BATCH_MAX];
+	struct seedwork work[SEED_BATCH_MAX];
+	char *pending[SEED_BATCH_MAX];
+	int which[SEED_BATCH_MAX];
+	int i, k, n, batch = (SEED_BATCH < SEED_BATCH_MAX)? SEED_BATCH : SEED_BATCH_MAX;
+	int mapped = 0;
+	long start, steps;
+	double share;
+
+	if (batch <= 1 || !index -> tree) {
+		for (i = 0; i < numreads; ++i) {
+			mapped += map_read (index, reads[i], table, &hits[i]);
+		}
+		return mapped;
+	}
+
+	for (i = 0; i < numreads; ) {
+		// Gather the next reads the cache cannot answer.
+		for (n = 0; i < numreads && n < batch; ++i) {
+			start = now_ns ();
+			if (lookup_read (index, reads[i], &hits[i])) {
+				hits[i].seedns = now_ns () - start;
+				mapped += hits[i].contig >= 0;
+			} else {
+				pending[n] = reads[i];
+				which[n++] = i;
+			}
+		}
+		if (!n) continue;
+
+		start = now_ns ();
+		find_loc_batch (index, n, pending, seeds, work);
+		start = now_ns () - start;
+		for (steps = k = 0; k < n; ++k) {
+			steps += work[k].nodes + work[k].edges;
+		}
+		for (k = 0; k < n; ++k) {
+			hits[which[k]].seed = work[k];
+			share = (steps)? (double) (work[k].nodes + work[k].edges) / steps : 1.0 / n;
+			hits[which[k]].seedns = (long) (start * share);
+			seed_approx (index, pending[k], &seeds[k], &hits[which[k]]);
+			align_seed (index, pending[k], &seeds[k], table, &hits[which[k]]);
+			mapped += hits[which[k]].contig >= 0;
+		}
+	}
+	return mapped;
+}
+
+
+// ============================================================================
+// Long reads
+// ============================================================================
+
+// An exact match between a long read and the genome, and the best chain of
+// matches ending with it.
+struct chainlink {
+	pos_t pos;				// Genome position of the match.
+	int readpos;			// Read position of the match.
+	int len;				// Length of the match.
+	int contig;				// Contig holding it.
+	int score;				// Score of the best chain ending with it.
+	int prev;				// Previous match of that chain, -1 if none.
+};
+
+
+void add_link (struct mapindex *index, struct chainlink **links, int *n, int *cap,
+				pos_t pos, int readpos, int len)
+// Append a match, growing the array as needed.
+{
+	if (*n == *cap) {
+		*cap = (*cap)? 2 * *cap : 256;
+		*links = (struct chainlink*) realloc (*links, sizeof (struct chainlink) * *cap);
+		if (!*links) {
+			perror ("Unable to allocate chain");
+			exit (1);
+		}
+	}
+	(*links)[*n].pos = pos;
+	(*links)[*n].readpos = readpos;
+	(*links)[*n].len = len;
+	(*links)[*n].contig = find_contig (index, pos);
+	++*n;
+}
+
+
+int link_chunks (struct mapindex *index, char *read, int readlen, struct chainlink **links,
+					struct hit *hit)
+// Seed each LONG_CHUNK bases of the read on their own, SEED_BATCH chunks at
+// a time with find_loc_batch, and add every occurrence of each chunk's
+// longest exact match as a link, unless it occurs more than MAX_OCC times.
+// Every link matches the read over the full seed length.
+// Each chunk is copied out with the LAMBDA - 1 bases that follow it, so
+// that matches can start anywhere in it.  Return the number of links.
+{
+	char chunks[SEED_BATCH_MAX][LONG_CHUNK + LAMBDA], *batch[SEED_BATCH_MAX];
+	struct seed seeds[SEED_BATCH_MAX];
+	struct seedwork work[SEED_BATCH_MAX];
+	int offsets[SEED_BATCH_MAX], size = (SEED_BATCH < SEED_BATCH_MAX)? SEED_BATCH : SEED_BATCH_MAX;
+	int chunk = 0, len, count, j, k, numchunks, n = 0, cap = 0;
 	struct node *deepest;
-	CELL **table;
+
+	if (size < 1) size = 1;
+	while (chunk + LAMBDA < readlen) {
+		for (numchunks = 0; numchunks < size && chunk + LAMBDA < readlen; ++numchunks) {
+			len = (readlen - chunk < LONG_CHUNK + LAMBDA - 1)? readlen - chunk : LONG_CHUNK + LAMBDA - 1;
+			memcpy (chunks[numchunks], read + chunk, len);
+			chunks[numchunks][len] = 0;
+			batch[numchunks] = chunks[numchunks];
+			offsets[numchunks] = chunk;
+			chunk += LONG_CHUNK;
+		}
+		find_loc_batch (index, numchunks, batch, seeds, work);
+		for (j = 0; j < numchunks; ++j) {
+			hit -> seed.nodes += work[j].nodes;
+			hit -> seed.edges += work[j].edges;
+			if (seeds[j].matches <= LAMBDA) continue;
+			// The match may end partway down an edge below the deepest node, and
+			// only that edge's leaves match it in full.
+			deepest = seeds[j].deepest;
+			if (seeds[j].matches > deepest -> strdepth) {
+				deepest = get_branch_count (index -> tree, chunks[j][seeds[j].pos + deepest -> strdepth],
+											deepest, &hit -> seed.edges);
+			}
+			count = deepest -> array_end - deepest -> array_start + 1;
+			if (count > MAX_OCC) {
+				++hit -> filtered;
+				continue;
+			}
+			expand_subtree (index -> tree, deepest);
+			for (k = 0; k < count; ++k) {
+				add_link (index, links, &n, &cap, get_leaf (index, deepest -> array_start + k),
+							offsets[j] + seeds[j].pos, seeds[j].matches);
+			}
+		}
+	}
+	return n;
+}
+
+
+int link_minimizers (struct mapindex *index, char *read, int readlen, struct chainlink **links,
+						struct hit *hit)
+// Add every genome occurrence of the read's minimizers as a link, skipping
+// minimizers that occur more than MAX_OCC times.  Return the number of links.
+{
+	struct minimizer *mins = NULL;
+	int j, k, m, n = 0, cap = 0;
+	long count, mincap = 0;
+	pos_t *positions;
+
+	m = find_minimizers (read, readlen, MINIMIZER_K, MINIMIZER_W, &mins, &mincap);
+	for (j = 0; j < m; ++j) {
+		positions = lookup_minimizer (index -> minimizers, mins[j].hash, &count);
+		if (count > MAX_OCC) {
+			++hit -> filtered;
+			continue;
+		}
+		for (k = 0; k < count; ++k) {
+			add_link (index, links, &n, &cap, positions[k], mins[j].pos, MINIMIZER_K);
+		}
+	}
+	free (mins);
+	hit -> anchors = n;
+	hit -> seed.nodes += m;
+	return n;
+}
+
+
+int compare_links (const void *a, const void *b)
+// Order links by genome position, then read position.
+{
+	const struct chainlink *x = (const struct chainlink*) a, *y = (const struct chainlink*) b;
+	if (x -> pos != y -> pos) return (x -> pos < y -> pos)? -1 : 1;
+	return x -> readpos - y -> readpos;
+}
+
+
+int chain_links (struct chainlink *links, int n)
+// Score the best chain ending with each link, the links sorted by genome
+// position.  A link extends a chain ending at most LONG_LOOKBACK links and
+// LONG_MAX_GAP bases earlier, in the same contig, that it follows in both
+// the read and the genome on a diagonal shifted by no more gaps than the
+// identity threshold allows over the distance between them.  It adds the
+// bases it newly covers less one per base of shift.  Return the last link
+// of the best chain.
+{
+	int i, j, dr, shift, gain, best = 0;
+	pos_t dg;
+
+	for (i = 0; i < n; ++i) {
+		links[i].score = links[i].len;
+		links[i].prev = -1;
+		for (j = i - 1; j >= 0 && i - j <= LONG_LOOKBACK; --j) {
+			dg = links[i].pos - links[j].pos;
+			if (dg > LONG_MAX_GAP) break;
+			dr = links[i].readpos - links[j].readpos;
+			if (dg <= 0 || dr <= 0 || dr > LONG_MAX_GAP || links[j].contig != links[i].contig) {
+				continue;
+			}
+			shift = abs (dr - dg);
+			if (shift > gap_margin ((dr > dg)? dr : dg)) continue;
+			gain = links[i].len;
+			if (dr < gain) gain = dr;
+			if (dg < gain) gain = dg;
+			if (links[j].score + gain - shift > links[i].score) {
+				links[i].score = links[j].score + gain - shift;
+				links[i].prev = j;
+			}
+		}
+		if (links[i].score > links[best].score) best = i;
+	}
+	return best;
+}
+
+
+void add_alignment (int *total, int *part, WORK *work, struct hit *hit)
+// Add one piece of a chain's alignment to its total, and the work it took.
+{
+	total[0] += part[0];
+	total[1] += part[1];
+	hit -> align.cells += work -> cells;
+}
+
+
+void align_chain (struct mapindex *index, char *read, int readlen, struct chainlink *links,
+					int last, DPTABLE *table, struct hit *hit)
+// Align the read along the chain ending at links[last] and record it as the
+// read's hit if it passes the thresholds.  Matches overlapping the one before
+// are trimmed, the read and genome between consecutive matches are aligned
+// globally within a band, and the read's ends beyond the first and last
+// matches are extended within a band from them.  The matches themselves are
+// taken without gaps.
+{
+	char *genome = index -> genome, *rev;
+	int *chain, count = 0, k, t, shift, r, len, reflen, margin;
+	pos_t g, start, end, cstart, cend;
+	int total[2] = { 0, 0 }, part[2], reach[2];
+	struct chainlink *link;
+	WORK work;
+
+	for (k = last; k >= 0; k = links[k].prev) ++count;
+	chain = (int*) malloc (sizeof (int) * count);
+	if (!chain) {
+		perror ("Unable to allocate chain");
+		exit (1);
+	}
+	for (k = last, t = count; k >= 0; k = links[k].prev) chain[--t] = k;
+	cstart = index -> contigstarts[links[last].contig];
+	cend = index -> contigstarts[links[last].contig + 1] - 1;
+
+	// Extend leftward from the first match, over reversed copies.
+	r = links[chain[0]].readpos;
+	g = start = links[chain[0]].pos;
+	if (r > 0) {
+		margin = gap_margin (r);
+		reflen = (g - cstart < r + margin)? g - cstart : r + margin;
+		rev = (char*) malloc (r + reflen);
+		if (!rev) {
+			perror ("Unable to allocate extension");
+			exit (1);
+		}
+		for (t = 0; t < r; ++t) rev[t] = read[r - 1 - t];
+		for (t = 0; t < reflen; ++t) rev[r + t] = genome[g - 1 - t];
+		align_banded (rev + r, reflen, rev, r, LONG_BAND, 1, part, reach, table, &work);
+		add_alignment (total, part, &work, hit);
+		start = g - reach[1];
+		free (rev);
+	}
+
+	// Each match, and the gap before it.
+	for (k = 0; k < count; ++k) {
+		link = &links[chain[k]];
+		shift = 0;
+		if (r - link -> readpos > shift) shift = r - link -> readpos;
+		if (g - link -> pos > shift) shift = g - link -> pos;
+		if (shift >= link -> len) continue;
+		if (k) {
+			align_banded (genome + g, link -> pos + shift - g, read + r, link -> readpos + shift - r,
+							LONG_BAND, 0, part, NULL, table, &work);
+			add_alignment (total, part, &work, hit);
+		}
+		r = link -> readpos + shift;
+		g = link -> pos + shift;
+		len = link -> len - shift;
+		for (t = 0; t < len; ++t) total[1] += read[r + t] == genome[g + t];
+		total[0] += len;
+		r += len;
+		g += len;
+	}
+
+	// Extend rightward from the last match.
+	end = g;
+	if (r < readlen) {
+		margin = gap_margin (readlen - r);
+		reflen = (cend - g < readlen - r + margin)? cend - g : readlen - r + margin;
+		align_banded (genome + g, reflen, read + r, readlen - r, LONG_BAND, 1, part, reach,
+						table, &work);
+		add_alignment (total, part, &work, hit);
+		end = g + reach[1];
+	}
+	free (chain);
+
+	hit -> locations = hit -> candidates = 1;
+	if (total[0]) record_hit (index, hit, links[last].contig, start, end, total, readlen, 0);
+}
+
+
+int map_long_read (struct mapindex *index, char *read, DPTABLE *table, struct hit *hit)
+// Map a read of any length onto the genome: find its exact matches with the
+// genome, chunk by chunk from the tree or from shared minimizers, chain
+// them, and align the read along the best chain as align_chain describes.
+// Memory and time grow with the read's length and its matches, not with
+// its square.  Long reads are not cached.  Return 1 if the read was a hit.
+{
+	struct chainlink *links = NULL;
+	int n, readlen = strlen (read);
+	long start = now_ns ();
+
+	clear_hit (hit);
+	if (index -> minimizers) {
+		n = link_minimizers (index, read, readlen, &links, hit);
+	} else {
+		n = link_chunks (index, read, readlen, &links, hit);
+	}
+	hit -> seedns = now_ns () - start;
+
+	start = now_ns ();
+	if (n) {
+		qsort (links, n, sizeof (struct chainlink), compare_links);
+		align_chain (index, read, readlen, links, chain_links (links, n), table, hit);
+	}
+	free (links);
+	hit -> alignns = now_ns () - start;
+	return hit -> contig >= 0;
+}
+
+
+void tally_read (struct mapindex *index, FILE *fpout, struct mapstats *stats,
+					struct slowreads *slow, char *readname, char *read, struct hit *hit)
+// Write one read's line to fpout and tally its outcome, work and latency in
+// stats.  The read is offered to the slow-read tracker, if one is given.
+{
+	// Output a hit if found.
+	if (hit -> contig >= 0) {
+		stats -> hits++;
+		fprintf (fpout, "%s %s %ld %ld\n", readname, 
+					index -> contignames[hit -> contig], (long) hit -> start, (long) hit -> end);
+	} else {
+		stats -> misses++;
+		fprintf (fpout, "%s: No hit found.\n", readname);
+	}
+	stats -> locations += hit -> locations;
+	stats -> alignments += hit -> candidates;
+	stats -> ungapped += hit -> ungapped;
+	stats -> fastreads += hit -> fast;
+	stats -> cachehits += hit -> cached;
+	stats -> approxreads += hit -> approx > 0;
+	stats -> approxseeds += hit -> approx > 1;
+	stats -> approxhits += hit -> approx > 1 && hit -> contig >= 0;
+	stats -> anchors += hit -> anchors;
+	stats -> filtered += hit -> filtered;
+	stats -> reads++;
+
+	// Tally the work done for the read.
+	stats -> nodes += hit -> seed.nodes;
+	stats -> edges += hit -> seed.edges;
+	stats -> cells += hit -> align.cells;
+	stats -> tracesteps += hit -> align.tracesteps;
+	if (hit -> seed.nodes > stats -> maxnodes) stats -> maxnodes = hit -> seed.nodes;
+	if (hit -> seed.edges > stats -> maxedges) stats -> maxedges = hit -> seed.edges;
+	if (hit -> candidates > stats -> maxalignments) stats -> maxalignments = hit -> candidates;
+	if (hit -> align.cells > stats -> maxcells) stats -> maxcells = hit -> align.cells;
+
+	// Record the read's latency.
+	hist_add (&stats -> seedlat, hit -> seedns);
+	hist_add (&stats -> alignlat, hit -> alignns);
+	hist_add (&stats -> totallat, hit -> seedns + hit -> alignns);
+	if (slow) {
+		offer_slowread (slow, readname, read, hit -> seedns, hit -> alignns, hit -> candidates);
+	}
+}
+
+
+void map_read_file (struct mapindex *index, FILE *fp, FILE *fpout, struct mapstats *stats,
+					struct slowreads *slow)
+// Map the reads in fp onto the genome, SEED_BATCH at a time, or one at a
+// time with map_long_read in long-read mode, writing one line per read to
+// fpout and tallying the outcome in stats.  Each read is
+// offered to the slow-read tracker, if one is given.  The calling thread's
+// TLB and NUMA counts over the run are kept in stats -> memory.
+{
+	char reads[SEED_BATCH_MAX][READ_LENGTH], readnames[SEED_BATCH_MAX][NAME_LENGTH];
+	char *batch[SEED_BATCH_MAX], *longread = NULL;
+	struct hit hits[SEED_BATCH_MAX];
+	int k, n, longcap = 0, size = (SEED_BATCH < SEED_BATCH_MAX)? SEED_BATCH : SEED_BATCH_MAX;
+	struct memcounters counters;
+	DPTABLE *table;
+
+	if (size < 1) size = 1;
+	bzero (stats, sizeof (struct mapstats));
+	table = new_dptable ();
+	start_memcounters (&counters);
+
+	// Long reads are read whole, however long, and mapped one at a time.
+	while (LONG_READS && (fp = get_next_long_read (&longread, &longcap, readnames[0], fp))) {
+		map_long_read (index, longread, table, &hits[0]);
+		tally_read (index, fpout, stats, slow, readnames[0], longread, &hits[0]);
+	}
+	free (longread);
+
+	// For each read, find a viable location in the suffix tree and align it with the genome.
+	while (fp) {
+		for (n = 0; n < size && (fp = get_next_read (reads[n], readnames[n], fp)); ++n) {
+			batch[n] = reads[n];
+		}
+		map_batch (index, n, batch, table, hits);
+		for (k = 0; k < n; ++k) {
+			tally_read (index, fpout, stats, slow, readnames[k], reads[k], &hits[k]);
+		}
+	}
+	stop_memcounters (&counters, &stats -> memory);
+	stats -> node = index -> node;
+	stats -> tablebytes = dptable_bytes (table);
+	free_dptable (table);
+}
+
+
+void print_latency (const char *label, struct histogram *hist)
+// Print one row of the latency table, in microseconds.
+{
+	printf ("%-20s %9.1lf %9.1lf %9.1lf %9.1lf\n", label,
+			hist_percentile (hist, 50.0) / 1000.0, hist_percentile (hist, 99.0) / 1000.0,
+			hist_percentile (hist, 99.9) / 1000.0, hist -> max / 1000.0);
+}
+
+
+double memory_rate (long part, long total)
+// Fraction of a hardware count, 0 if nothing was counted.
+{
+	return (total > 0)? (double) part / total : 0.0;
+}
+
+
+void print_memory (struct mapindex *index, struct mapstats *stats)
+// Print how the index was placed and how the mapping thread used memory.
+{
+	long huge = index_huge_bytes (index), bytes = index_bytes (index);
+
+	printf ("Index pages:             %s, ", (index -> placed)? pages_name (index -> backing) : "not placed");
+	if (huge < 0) {
+		printf ("huge-page coverage unavailable\n");
+	} else {
+		printf ("%.1lf of %.1lf MB on huge pages (%.1lf%%)\n", huge / 1048576.0,
+				bytes / 1048576.0, memory_rate (huge, bytes) * 100.0);
+	}
+	if (index -> replicas) {
+		printf ("NUMA replicas:           %d, mapped on node %d\n",
+				index -> topo -> numnodes, stats -> node);
+	}
+	if (stats -> memory.dtlbvalid) {
+		printf ("Data TLB miss rate:      %.3lf%% (%ld of %ld loads)\n",
+				memory_rate (stats -> memory.dtlbmisses, stats -> memory.dtlbloads) * 100.0,
+				stats -> memory.dtlbmisses, stats -> memory.dtlbloads);
+	} else {
+		printf ("Data TLB miss rate:      unavailable\n");
+	}
+	if (stats -> memory.nodevalid) {
+		printf ("Remote memory accesses:  %.3lf%% (%ld of %ld loads)\n",
+				memory_rate (stats -> memory.nodemisses, stats -> memory.nodeloads) * 100.0,
+				stats -> memory.nodemisses, stats -> memory.nodeloads);
+	} else {
+		printf ("Remote memory accesses:  unavailable\n");
+	}
+}
+
+
+void map_reads (struct mapindex *index, const char *readfile, const char *writefile, 
+				struct mapstats *stats, struct slowreads *slow)
+// Map the reads one-by-one onto the genome, tallying the outcome in stats.
+{
 	FILE *fp, *fpout;
 	
-	allocate_table (&table, READ_LENGTH*2, READ_LENGTH);
 	printf ("Redirecting output to %s\n", writefile);
 
 	// Open the read file and the output file.
 	fpout = open_file_write (writefile);
 	fp = open_file_read (readfile);
-	fp = get_next_read (read, readname, fp);
+	map_read_file (index, fp, fpout, stats, slow);
+	fclose (fp);
+	fclose (fpout);
+	print_results (index, stats);
+}
 
-	// For each read, find a viable location in the suffix tree and align it with the genome.
-	while (fp /*&& i <= 3000*/) {  /// !!!!! HACK ALERT !!!!! Remove i condition! (inserted for testing speed)
-		readlen = strlen (read);						
-		deepest = find_loc_BF (readlen, tree, read, &matches);
-
-		// Perform an alignment between each location
-		if (matches > LAMBDA) { 
-			// Loop over the range of values in the leaf array for alignment locales in the genome.
-			numleaves += (deepest -> array_end - deepest -> array_start + 1);
-			for (j = deepest -> array_start; j <= deepest -> array_end; ++j) {
-				gslice = retrieve_substring (&slicelen, leafarray[j] - readlen, leafarray[j] + readlen);
-				// Perform local align between the genome slice and the read.
-				score = align_loc (gslice, slicelen, read, matchalign, &table);
-				identity = ((double) matchalign[1] / (double) matchalign[0]) * 100.0;
-				coverage = ((double) matchalign[0] / (double) readlen) * 100.0;
-
-				// Check if the read was a hit.  If so, record it if it was the best so far.
-				if (identity >= X && coverage >= Y) {
-					if (coverage > maxcoverage) {
-						maxcoverage = coverage;
-						hitstart = leafarray[j] - readlen;
-						hitend = leafarray[j] + readlen;
-					}
-				}
-			}
+
+void print_results (struct mapindex *index, struct mapstats *stats)
+// Print the results of a mapping run.
+{
+	long lookups, cachehits, cachebytes;
+
+	printf ("\n***************       RESULTS      ********************\n");
+	printf ("Number of reads mapped:  %d\n", stats -> reads);
+	printf ("Genome length:           %ld\n",
+			(long) (index -> contigstarts[index -> numcontigs] - index -> numcontigs));
+	printf ("Number of contigs:       %d\n", index -> numcontigs);
+	printf ("Number of HITS:          %d\n", stats -> hits);
+	printf ("Number of MISSES:        %d\n", stats -> misses);
+	printf ("Average number of alignments per read = %.2lf\n", 
+			(stats -> reads)? (double) stats -> alignments / stats -> reads : 0.0);
+	printf ("Reads resolved ungapped: %d (%ld of %ld candidates)\n",
+			stats -> fastreads, stats -> ungapped, stats -> alignments);
+	printf ("Candidates skipped by early exit: %ld of %ld\n",
+			stats -> locations - stats -> alignments, stats -> locations);
+	if (index -> minimizers) {
+		printf ("Minimizer anchors:       %.2lf per read, %ld repetitive minimizers skipped\n",
+				(stats -> reads)? (double) stats -> anchors / stats -> reads : 0.0, stats -> filtered);
+	}
+	if (index -> reads) {
+		printf ("Read index:              %d reads, %ld maximal matches with the genome (%.2lf per read)\n",
+				index -> reads -> numcontigs, stats -> maximal,
+				(stats -> reads)? (double) stats -> maximal / stats -> reads : 0.0);
+	}
+	if (index -> tree && index -> tree -> suffixes) {
+		printf ("Lazy tree nodes:         %ld of %ld expanded (%.1lf%%), %.1lf MB\n",
+				(long) index -> tree -> idCnt, (long) MAX_NODES (index -> tree -> slen),
+				index -> tree -> idCnt * 100.0 / MAX_NODES (index -> tree -> slen),
+				index -> tree -> idCnt * (double) sizeof (struct node) / (1 << 20));
+	}
+	if (APPROX_EDITS > 0) {
+		printf ("Approximate seeding:     %d reads without an exact seed, %d seeded, %d hits\n",
+				stats -> approxreads, stats -> approxseeds, stats -> approxhits);
+	}
+	if (index -> cache) {
+		cache_totals (index -> cache, &lookups, &cachehits, &cachebytes);
+		printf ("Read cache hits:         %d of %d reads (%.1lf%%), %ld bytes\n",
+				stats -> cachehits, stats -> reads,
+				(stats -> reads)? stats -> cachehits * 100.0 / stats -> reads : 0.0, cachebytes);
+	}
+	print_memory (index, stats);
+	printf ("Per-read latency (us)    p50       p99     p99.9       max\n");
+	print_latency ("  seeding", &stats -> seedlat);
+	print_latency ("  alignment", &stats -> alignlat);
+	print_latency ("  total", &stats -> totallat);
+	printf ("*******************************************************\n\n");
+}
+
+
+// ============================================================================
+// Inverted mapping
+// ============================================================================
+
+// With a few reads against a large genome, the tree is built over the reads
+// instead, joined by SEPARATOR as the contigs of a genome are, and the genome
+// is streamed past it.  Its matching statistics, the longest prefix of the
+// genome at each position that occurs in some read, are found one position
+// from the last by following a suffix link, as McCreight's algorithm does.
+// Every maximal exact match longer than LAMBDA between a read and the genome
+// is found along the way, and each read is aligned by align_seed at the loci
+// its matches put it at, one per diagonal.
+
+// A maximal exact match between a read and the genome.
+struct readmatch {
+	int read;				// Read of the match.
+	int readpos;			// Position of the match in the read.
+	pos_t pos;				// Genome position of the match.
+	int len;				// Length of the match.
+};
+
+// Matches found while streaming the genome, and the work it took.
+struct matchlist {
+	struct readmatch *matches;
+	int n, cap;
+	struct seedwork work;	// Read tree nodes visited and child edges compared.
+};
+
+
+struct mapindex *build_read_index (const char *readfile, char *alphabet)
+// Read every read in the read file into one sequence, joined by SEPARATOR
+// as the contigs of a genome are, and build the suffix tree over it.  Return
+// an index whose contigs are the reads, or NULL if the file holds none.
+{
+	char read[READ_LENGTH], readname[NAME_LENGTH], *seq = NULL, **names = NULL;
+	int n = 0, cap = 0, readlen;
+	pos_t *starts = NULL, len = 0;
+	size_t seqcap = 0;
+	FILE *fp = open_file_read (readfile), *in = fp;
+	struct mapindex *index;
+
+	while ((in = get_next_read (read, readname, in))) {
+		readlen = strlen (read);
+		if (n == cap) {
+			cap = (cap)? 2 * cap : 1024;
+			names = (char**) realloc (names, sizeof (char*) * cap);
+			starts = (pos_t*) realloc (starts, sizeof (pos_t) * (cap + 1));
 		}
+		// Room for the separator, and for the tree's terminator and NUL.
+		check_length (len + readlen + 2, readfile);
+		if ((size_t) (len + readlen + 3) > seqcap) {
+			seqcap = 2 * (len + readlen + 3);
+			seq = (char*) realloc (seq, seqcap);
+		}
+		if (!names || !starts || !seq || !(names[n] = (char*) malloc (NAME_LENGTH))) {
+			perror ("Unable to allocate read index");
+			exit (1);
+		}
+		if (n > 0) seq[len++] = SEPARATOR;
+		starts[n] = len;
+		memcpy (seq + len, read, readlen);
+		len += readlen;
+		memcpy (names[n++], readname, NAME_LENGTH);
+	}
+	fclose (fp);
+	if (!n) return NULL;
+	seq[len] = 0;
+	starts[n] = len + 1;
+
+	index = new_index (seq, names, starts, n);
+	index -> tree = build_tree (seq, alphabet);
+	return index;
+}
 
-		// Output a hit if found.
-		if (maxcoverage > 0.0) {
-			hits++;
-			fprintf (fpout, "%s %d %d\n", readname, hitstart, hitend);
-		} else {
-			nohits++;
-			fprintf (fpout, "%s: No hit found.\n", readname);
+
+void add_readmatch (struct mapindex *reads, struct matchlist *list, pos_t sfx, pos_t pos, int len)
+// Append the match of the read sequence's suffix sfx with the genome from pos.
+{
+	struct readmatch *match;
+
+	if (list -> n == list -> cap) {
+		list -> cap = (list -> cap)? 2 * list -> cap : 1024;
+		list -> matches = (struct readmatch*) realloc (list -> matches,
+													sizeof (struct readmatch) * list -> cap);
+		if (!list -> matches) {
+			perror ("Unable to allocate read matches");
+			exit (1);
 		}
-		maxcoverage = 0.0; ++i;
+	}
+	match = &list -> matches[list -> n++];
+	match -> read = find_contig (reads, sfx);
+	match -> readpos = sfx - reads -> contigstarts[match -> read];
+	match -> pos = pos;
+	match -> len = len;
+}
 
-		// Get the next read from the read file.
-		fp = get_next_read (read, readname, fp);
+
+void add_maximal (struct mapindex *reads, struct matchlist *list, char *genome, pos_t pos,
+					pos_t from, pos_t to, int len)
+// Add the matches of length len between the genome from pos and the read
+// suffixes of leaves from to to, except those that extend to the left,
+// which were added at an earlier position.
+{
+	char *seq = reads -> genome;
+	pos_t k, sfx;
+
+	for (k = from; k <= to; ++k) {
+		sfx = get_leaf (reads, k);
+		if (pos == 0 || sfx == 0 || genome[pos - 1] == SEPARATOR || seq[sfx - 1] != genome[pos - 1]) {
+			add_readmatch (reads, list, sfx, pos, len);
+		}
 	}
-	free_table (&table, READ_LENGTH*2, READ_LENGTH);
+}
 
-	// Print results of the read mapping.
-	printf ("\n***************       RESULTS      ********************\n");
-	printf ("Number of reads mapped:  %d\n", i);
-	printf ("Genome length:           %d\n", slen);
-	printf ("Number of HITS:          %d\n", hits);
-	printf ("Number of MISSES:        %d\n", nohits);
-	avg = numleaves / i;
-	printf ("Average number of alignments per read = %d\n", avg);
-	printf ("*******************************************************\n\n");
+
+void collect_matches (struct mapindex *reads, struct matchlist *list, char *genome, pos_t pos,
+						struct node *v, struct node *w, int len)
+// Add the maximal matches starting at genome position pos, whose longest
+// match with the reads, len bases long, ends at node v or partway down the
+// edge to its child w.  The read suffixes below where it ends match all len
+// bases; those that branch off above, at a node deeper than LAMBDA, match
+// down to that node.
+{
+	struct node *u = (len > v -> strdepth)? w : v;
+	pos_t from = u -> array_start, to = u -> array_end;
+
+	add_maximal (reads, list, genome, pos, from, to, len);
+	for (u = u -> parent; u && u -> strdepth > LAMBDA; u = u -> parent) {
+		add_maximal (reads, list, genome, pos, u -> array_start, from - 1, u -> strdepth);
+		add_maximal (reads, list, genome, pos, to + 1, u -> array_end, u -> strdepth);
+		from = u -> array_start;
+		to = u -> array_end;
+	}
+}
+
+
+void stream_genome (struct mapindex *index, struct matchlist *list)
+// Stream the genome past the index's read tree, finding each position's
+// longest match with the reads from the last one's, and collect every
+// maximal match longer than LAMBDA.  The match is kept as the deepest node
+// v it passes and, if it ends partway down an edge, the child w below.
+// Dropping its first base leads from v by the suffix link to the node
+// spelling the rest of v's path, from which the rest of the match is found
+// again by edge lengths alone, without comparing bases.
+{
+	struct stree *st = index -> reads -> tree;
+	struct node *v = st -> root, *w = NULL;
+	char *genome = index -> genome, *input = st -> input_string, c;
+	pos_t pos, glen = index -> contigstarts[index -> numcontigs] - 1;
+	int len = 0;
+
+	for (pos = 0; pos < glen; ++pos) {
+		// Extend the match as far as it goes.  A separator in the genome ends
+		// it, and one in the reads never matches the genome's bases.
+		while (pos + len < glen && (c = genome[pos + len]) != SEPARATOR) {
+			if (len == v -> strdepth) {
+				++list -> work.nodes;
+				if (!(w = get_branch_count (st, c, v, &list -> work.edges))) break;
+			}
+			if (input[w -> starti + len - v -> strdepth] != c) break;
+			if (++len == w -> strdepth) v = w;
+		}
+		if (len > LAMBDA) collect_matches (index -> reads, list, genome, pos, v, w, len);
+		if (!len) continue;
+
+		// Move on to the next position.  A leaf has no suffix link, so the
+		// match is found again from the root.
+		--len;
+		v = (v -> sfxlink)? v -> sfxlink : st -> root;
+		while (len > v -> strdepth) {
+			++list -> work.nodes;
+			w = get_branch_count (st, genome[pos + 1 + v -> strdepth], v, &list -> work.edges);
+			if (len < w -> strdepth) break;
+			v = w;
+		}
+	}
+}
+
+
+int compare_diagonals (const void *a, const void *b)
+// Order matches by read, then by the genome position they put its start at,
+// longest first.
+{
+	const struct readmatch *x = (const struct readmatch*) a, *y = (const struct readmatch*) b;
+	if (x -> read != y -> read) return x -> read - y -> read;
+	if (x -> pos - x -> readpos != y -> pos - y -> readpos) {
+		return (x -> pos - x -> readpos < y -> pos - y -> readpos)? -1 : 1;
+	}
+	return y -> len - x -> len;
+}
+
+
+int compare_readmatches (const void *a, const void *b)
+// Order matches by read, longest first, then by genome and read position.
+{
+	const struct readmatch *x = (const struct readmatch*) a, *y = (const struct readmatch*) b;
+	if (x -> read != y -> read) return x -> read - y -> read;
+	if (x -> len != y -> len) return y -> len - x -> len;
+	if (x -> pos != y -> pos) return (x -> pos < y -> pos)? -1 : 1;
+	return x -> readpos - y -> readpos;
+}
+
+
+int distinct_loci (struct matchlist *list)
+// Keep only the longest of a read's matches on each diagonal, as the rest
+// put the read at the same locus, and order them by read, longest first.
+// Return the number kept.
+{
+	int j, n = 0;
+
+	qsort (list -> matches, list -> n, sizeof (struct readmatch), compare_diagonals);
+	for (j = 0; j < list -> n; ++j) {
+		if (n && list -> matches[j].read == list -> matches[n - 1].read
+				&& list -> matches[j].pos - list -> matches[j].readpos
+					== list -> matches[n - 1].pos - list -> matches[n - 1].readpos) continue;
+		list -> matches[n++] = list -> matches[j];
+	}
+	qsort (list -> matches, n, sizeof (struct readmatch), compare_readmatches);
+	return list -> n = n;
+}
+
+
+void map_reads_inverted (struct mapindex *index, const char *writefile, struct mapstats *stats,
+							struct slowreads *slow)
+// Map the reads of the index's read index onto the genome: stream the
+// genome past them, then align each read in turn at the loci of its
+// maximal matches, longest first, as align_seed does for a tree seed's,
+// writing one line per read to the write file.  Each read is charged an
+// equal share of the streaming.  Tally the outcome in stats and print it.
+{
+	struct mapindex *reads = index -> reads;
+	struct matchlist list;
+	struct memcounters counters;
+	struct seed seed;
+	struct hit hit;
+	char read[READ_LENGTH];
+	int *locpos, r, j, n, readlen;
+	pos_t *locs;
+	long start;
+	DPTABLE *table;
+	FILE *fpout;
+
+	printf ("Redirecting output to %s\n", writefile);
+	fpout = open_file_write (writefile);
+	bzero (stats, sizeof (struct mapstats));
+	bzero (&list, sizeof (struct matchlist));
+	table = new_dptable ();
+	start_memcounters (&counters);
+
+	start = now_ns ();
+	stream_genome (index, &list);
+	stats -> maximal = list.n;
+	distinct_loci (&list);
+	locs = (pos_t*) malloc (sizeof (pos_t) * ((list.n)? list.n : 1));
+	locpos = (int*) malloc (sizeof (int) * ((list.n)? list.n : 1));
+	if (!locs || !locpos) {
+		perror ("Unable to allocate read matches");
+		exit (1);
+	}
+	for (j = 0; j < list.n; ++j) {
+		locs[j] = list.matches[j].pos;
+		locpos[j] = list.matches[j].readpos;
+	}
+	start = (now_ns () - start) / reads -> numcontigs;
+
+	for (r = j = 0; r < reads -> numcontigs; ++r) {
+		readlen = reads -> contigstarts[r + 1] - 1 - reads -> contigstarts[r];
+		memcpy (read, reads -> genome + reads -> contigstarts[r], readlen);
+		read[readlen] = 0;
+
+		// The read's loci are the next run of the list.
+		for (n = 0; j + n < list.n && list.matches[j + n].read == r; ++n);
+		seed.deepest = NULL;
+		seed.matches = (n)? list.matches[j].len : 0;
+		seed.pos = (n)? list.matches[j].readpos : 0;
+		seed.locs = (n)? &locs[j] : NULL;
+		seed.locpos = (n)? &locpos[j] : NULL;
+		seed.numlocs = n;
+		j += n;
+
+		if (!lookup_read (index, read, &hit)) align_seed (index, read, &seed, table, &hit);
+		hit.seedns = start;
+		hit.seed.nodes = list.work.nodes / reads -> numcontigs;
+		hit.seed.edges = list.work.edges / reads -> numcontigs;
+		tally_read (index, fpout, stats, slow, reads -> contignames[r], read, &hit);
+	}
+	stop_memcounters (&counters, &stats -> memory);
+	stats -> node = index -> node;
+	stats -> tablebytes = dptable_bytes (table);
+	free_dptable (table);
+	free (list.matches);
+	free (locs);
+	free (locpos);
+	fclose (fpout);
+	print_results (index, stats);
 }
 
 
@@ -271,16 +2125,131 @@ void map_reads (struct node *tree, const char *readfile, const char *writefile)
 // Execution of Algorithm
 // ============================================================================
 
-void exec_mapread (const char *genomefile, const char *readfile, const char *alphabetfile)
+double per_read (long total, int reads)
+// Average a total over the given number of reads.
+{
+	return (reads)? (double) total / reads : 0.0;
+}
+
+
+void write_latency (FILE *fp, const char *label, struct histogram *hist, const char *sep)
+// Write the percentiles of one latency histogram as a JSON member.
+{
+	fprintf (fp, "    \"%s\": {\"p50\": %ld, \"p99\": %ld, \"p99_9\": %ld, \"max\": %ld}%s\n",
+			label, hist_percentile (hist, 50.0), hist_percentile (hist, 99.0),
+			hist_percentile (hist, 99.9), hist -> max, sep);
+}
+
+
+void write_metrics (const char *metricsfile, struct mapindex *index, 
+					struct mapstats *stats, double *stagems)
+// Write the mapping counters, the build/prepare/map/total stage times in
+// stagems, and the bytes allocated to each structure as JSON.
+{
+	struct mapindex *treeindex = (index -> reads)? index -> reads : index;
+	struct stree *st = treeindex -> tree;
+	FILE *fp = open_file_write (metricsfile);
+	long lookups = 0, cachehits = 0, cachebytes = 0;
+
+	if (index -> cache) cache_totals (index -> cache, &lookups, &cachehits, &cachebytes);
+
+	fprintf (fp, "{\n");
+	fprintf (fp, "  \"reads\": %d,\n", stats -> reads);
+	fprintf (fp, "  \"hits\": %d,\n", stats -> hits);
+	fprintf (fp, "  \"misses\": %d,\n", stats -> misses);
+	fprintf (fp, "  \"stages_ms\": {\"build\": %.3lf, \"prepare\": %.3lf, \"map\": %.3lf, \"total\": %.3lf},\n",
+			stagems[0], stagems[1], stagems[2], stagems[3]);
+	fprintf (fp, "  \"seeding\": {\"nodes_visited\": %ld, \"nodes_per_read\": %.3lf, \"max_nodes_per_read\": %ld,\n",
+			stats -> nodes, per_read (stats -> nodes, stats -> reads), stats -> maxnodes);
+	fprintf (fp, "              \"edges_compared\": %ld, \"edges_per_read\": %.3lf, \"max_edges_per_read\": %ld},\n",
+			stats -> edges, per_read (stats -> edges, stats -> reads), stats -> maxedges);
+	fprintf (fp, "  \"minimizers\": {\"enabled\": %s, \"k\": %d, \"w\": %d, \"max_occ\": %d, \"distinct\": %ld, \"positions\": %ld,\n",
+			(index -> minimizers)? "true" : "false", MINIMIZER_K, MINIMIZER_W, MAX_OCC,
+			(index -> minimizers)? index -> minimizers -> numkeys : 0L,
+			(index -> minimizers)? index -> minimizers -> numpositions : 0L);
+	fprintf (fp, "                 \"anchors\": %ld, \"anchors_per_read\": %.3lf, \"skipped_repetitive\": %ld},\n",
+			stats -> anchors, per_read (stats -> anchors, stats -> reads), stats -> filtered);
+	fprintf (fp, "  \"lazy_tree\": {\"enabled\": %s, \"nodes_expanded\": %ld, \"internal\": %ld, \"leaves\": %ld},\n",
+			(st && st -> suffixes)? "true" : "false", (st && st -> suffixes)? (long) st -> idCnt : 0L,
+			(st && st -> suffixes)? (long) st -> numints : 0L, (st && st -> suffixes)? (long) st -> numleaves : 0L);
+	fprintf (fp, "  \"inverted\": {\"enabled\": %s, \"reads_indexed\": %d, \"maximal_matches\": %ld},\n",
+			(index -> reads)? "true" : "false", (index -> reads)? index -> reads -> numcontigs : 0,
+			stats -> maximal);
+	fprintf (fp, "  \"approximate_seeding\": {\"max_edits\": %d, \"budget\": %ld, \"reads\": %d, \"seeded\": %d, \"hits\": %d},\n",
+			APPROX_EDITS, APPROX_BUDGET, stats -> approxreads, stats -> approxseeds, stats -> approxhits);
+	fprintf (fp, "  \"candidates\": {\"total\": %ld, \"per_read\": %.3lf, \"max_per_read\": %ld,\n",
+			stats -> alignments, per_read (stats -> alignments, stats -> reads), stats -> maxalignments);
+	fprintf (fp, "                 \"resolved_ungapped\": %ld, \"reads_resolved_ungapped\": %d,\n",
+			stats -> ungapped, stats -> fastreads);
+	fprintf (fp, "                 \"seed_locations\": %ld, \"skipped_early_exit\": %ld},\n",
+			stats -> locations, stats -> locations - stats -> alignments);
+	fprintf (fp, "  \"read_cache\": {\"enabled\": %s, \"capacity\": %ld, \"hits\": %d, \"hit_rate\": %.5lf},\n",
+			(index -> cache)? "true" : "false",
+			(index -> cache)? (long) index -> cache -> slots * CACHE_SHARDS : 0L,
+			stats -> cachehits, per_read (stats -> cachehits, stats -> reads));
+	fprintf (fp, "  \"alignment\": {\"dp_cells\": %ld, \"cells_per_read\": %.3lf, \"max_cells_per_read\": %ld,\n",
+			stats -> cells, per_read (stats -> cells, stats -> reads), stats -> maxcells);
+	fprintf (fp, "                \"traceback_steps\": %ld, \"steps_per_read\": %.3lf},\n",
+			stats -> tracesteps, per_read (stats -> tracesteps, stats -> reads));
+	fprintf (fp, "  \"memory\": {\"pages\": \"%s\", \"index_bytes\": %ld, \"huge_page_bytes\": %ld,\n",
+			(index -> placed)? pages_name (index -> backing) : "unplaced", index_bytes (index),
+			index_huge_bytes (index));
+	fprintf (fp, "             \"numa_replicas\": %d, \"node\": %d,\n",
+			(index -> replicas)? index -> topo -> numnodes : 1, stats -> node);
+	if (stats -> memory.dtlbvalid) {
+		fprintf (fp, "             \"dtlb_loads\": %ld, \"dtlb_misses\": %ld, \"dtlb_miss_rate\": %.6lf,\n",
+				stats -> memory.dtlbloads, stats -> memory.dtlbmisses,
+				memory_rate (stats -> memory.dtlbmisses, stats -> memory.dtlbloads));
+	} else {
+		fprintf (fp, "             \"dtlb_loads\": null, \"dtlb_misses\": null, \"dtlb_miss_rate\": null,\n");
+	}
+	if (stats -> memory.nodevalid) {
+		fprintf (fp, "             \"node_loads\": %ld, \"remote_loads\": %ld, \"remote_rate\": %.6lf},\n",
+				stats -> memory.nodeloads, stats -> memory.nodemisses,
+				memory_rate (stats -> memory.nodemisses, stats -> memory.nodeloads));
+	} else {
+		fprintf (fp, "             \"node_loads\": null, \"remote_loads\": null, \"remote_rate\": null},\n");
+	}
+	fprintf (fp, "  \"latency_ns\": {\n");
+	write_latency (fp, "seeding", &stats -> seedlat, ",");
+	write_latency (fp, "alignment", &stats -> alignlat, ",");
+	write_latency (fp, "total", &stats -> totallat, "");
+	fprintf (fp, "  },\n");
+	fprintf (fp, "  \"bytes\": {\"tree_nodes\": %ld, \"tree_reserved\": %ld, \"leafarray\": %ld,\n",
+			(st)? (long) st -> idCnt * sizeof (struct node) : 0L,
+			(st)? (long) MAX_NODES (st -> slen) * sizeof (struct node) : 0L,
+			(long) leaf_bytes (treeindex));
+	fprintf (fp, "            \"position_bytes\": %d, \"leaf_bits\": %d,\n",
+			(int) sizeof (pos_t), (st && !st -> suffixes)? treeindex -> leafarray.bits : 0);
+	fprintf (fp, "            \"minimizer_index\": %ld,\n",
+			(index -> minimizers)? minindex_bytes (index -> minimizers) : 0L);
+	fprintf (fp, "            \"genome\": %ld, \"contig_table\": %ld, \"dp_table\": %ld, \"read_cache\": %ld}\n",
+			(long) index -> contigstarts[index -> numcontigs] + 1,
+			(long) index -> numcontigs * (sizeof (char*) + sizeof (pos_t) + NAME_LENGTH) + sizeof (pos_t),
+			stats -> tablebytes, cachebytes);
+	fprintf (fp, "}\n");
+	fclose (fp);
+}
+
+
+void exec_mapread (const char *genomefile, const char *readfile, const char *alphabetfile,
+					struct mapopts *opts)
 // Execute the read mapping sequence.
 //	1.  Build ST
 //	2.	Prepare ST
 //	3. 	Map Reads
 //	4.	Output
+// When a metrics file is given, export the run's counters to it as JSON, and
+// when a slow-read file is given, write the slowest reads to it.
 {
-	char *alphabet, *genome, *name, writefile[256];
-	int i;
-	struct node *tree;
+	char *alphabet, *genome, **names, writefile[256];
+	pos_t *starts;
+	int numcontigs;
+	struct mapindex *index;
+	struct mapstats stats;
+	struct slowreads slow;
+	double stagems[4];
+	FILE *fp;
 
 	// TIMER VARIABLES =================
 	struct timeval startwhole, endwhole, startbuild, endbuild, 
@@ -292,7 +2261,11 @@ void exec_mapread (const char *genomefile, const char *readfile, const char *alp
 	// 0. Read in genome and alphabet.
 	printf ("\n0.  Reading files ....\n");
 	read_alphabet (&alphabet, alphabetfile);
-	read_fasta (&name, &genome, alphabet, genomefile);
+	numcontigs = read_fasta_all (&names, &starts, &genome, alphabet, genomefile);
+	if (!numcontigs) {
+		printf ("No sequences found in %s.\n", genomefile);
+		exit (1);
+	}
 	bzero (writefile, 256);
 	strcat (writefile, "MappingResults_");
 	strcat (writefile, readfile + 7);
@@ -304,9 +2277,20 @@ void exec_mapread (const char *genomefile, const char *readfile, const char *alp
 		// BEGIN TIMER ST BUILD ==========================================
 		gettimeofday(&startbuild, NULL);
 
-		// 1. Build the suffix tree.
-		printf ("1.  Building suffix tree ....\n");
-		tree = build_tree (genome, alphabet);
+		// 1. Build the suffix tree, or the lazy tree's root, or the minimizer index,
+		// or in inverted mode the suffix tree over the reads.
+		if (opts -> inverted) {
+			printf ("1.  Building suffix tree over the reads ....\n");
+			index = new_index (genome, names, starts, numcontigs);
+			if (!(index -> reads = build_read_index (readfile, alphabet))) {
+				printf ("No reads found in %s.\n", readfile);
+				exit (1);
+			}
+		} else {
+			printf ("1.  Building %s ....\n", (SEED_INDEX == SEEDS_MINIMIZER)? "minimizer index" :
+						(SEED_INDEX == SEEDS_LAZY)? "lazy suffix tree" : "suffix tree");
+			index = build_index (genome, names, starts, numcontigs, alphabet);
+		}
 
 		// END TIMER ST BUILD ============================================
 		gettimeofday(&endbuild, NULL);
@@ -322,8 +2306,17 @@ void exec_mapread (const char *genomefile, const char *readfile, const char *alp
 
 		//	2. Prepare the tree and record leaf lists.
 		printf ("2.  Preparing suffix tree ....\n");
-		nextindex = 0;
-		prepare_tree (tree);
+		prepare_tree (index);
+		if (!opts -> inverted) enable_cache (index, opts -> cacheentries);
+		if (opts -> pages >= 0) {
+			place_index (index, opts -> pages);
+			if (index -> placed) printf ("      >Index placed on %s pages\n", pages_name (index -> backing));
+		}
+		if (opts -> numa) {
+			printf ("      >Index replicated on %d NUMA node(s)\n",
+					replicate_index (index, (opts -> pages >= 0)? opts -> pages : PAGES_NORMAL));
+			if (index -> topo) pin_to_node (index -> topo, index -> node);
+		}
 
 		// END TIMER PREPARATION ============================================
 		gettimeofday(&endprep, NULL);
@@ -339,7 +2332,12 @@ void exec_mapread (const char *genomefile, const char *readfile, const char *alp
 		
 		// 	3.  Map Reads onto Genome
 		printf ("3.  Mapping reads ....\n");
-		map_reads (tree, readfile, writefile);
+		init_slowreads (&slow, (opts -> slowfile)? opts -> slowcount : 0);
+		if (opts -> inverted) {
+			map_reads_inverted (index, writefile, &stats, &slow);
+		} else {
+			map_reads (index, readfile, writefile, &stats, &slow);
+		}
 
 		// END TIMER READ MAPPING ============================================
 		gettimeofday(&endread, NULL);
@@ -359,10 +2357,24 @@ void exec_mapread (const char *genomefile, const char *readfile, const char *alp
 
 	printf ("==== Elapsed time (Total): %lf ms\n", elapsedwhole);
 
+	// 4. Export metrics and slow reads if requested.
+	if (opts -> metricsfile) {
+		stagems[0] = elapsedbuild; stagems[1] = elapsedprep;
+		stagems[2] = elapsedread; stagems[3] = elapsedwhole;
+		write_metrics (opts -> metricsfile, index, &stats, stagems);
+		printf ("Metrics written to %s\n", opts -> metricsfile);
+	}
+	if (opts -> slowfile) {
+		fp = open_file_write (opts -> slowfile);
+		printf ("%d slowest reads written to %s\n", slow.count, opts -> slowfile);
+		write_slowreads (&slow, fp);
+		fclose (fp);
+	}
+	free_slowreads (&slow);
 
 	// Clean up
-	free_tree (tree);
-	free (leafarray);
+	free_index (index);
+	free (alphabet);
 
 }
 
@@ -370,7 +2382,16 @@ void exec_mapread (const char *genomefile, const char *readfile, const char *alp
 void print_usage_and_exit ()
 // Advise the user of usage and exit.
 {
-	printf ("USAGE: <map read exe> <FASTA genome> <FASTA reads> <alphabet file>\n");
+	printf ("USAGE: <map read exe> [--metrics <JSON file>] [--slow <N> <FASTA file>]\n");
+	printf ("                      [--exit <all | first | best | top<N>>] [--cache <N>]\n");
+	printf ("                      [--batch <N>] [--pages <normal | thp | hugetlb>] [--numa]\n");
+	printf ("                      [--approx <edits>] [--approx-budget <steps>]\n");
+	printf ("                      [--seeds <tree | lazy | minimizer>] [--minimizer <k> <w>] [--max-occ <N>]\n");
+	printf ("                      [--long] [--inverted] [--inflate-threads <N>]\n");
+	printf ("                      <FASTA genome> <FASTA/FASTQ reads, may be gzipped> <alphabet file>\n");
+	printf ("       <map read exe> [options] --serve <socket> <FASTA genome> <alphabet file>\n");
+	printf ("       <map read exe> --client <socket> <FASTA reads | -> [output file]\n");
+	printf ("       <map read exe> --stop <socket>\n");
 	exit (1);
 }
 
@@ -7,11 +7,17 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <sys/time.h>
 #include <sys/types.h>
 #include <unistd.h>
 #include "../sfxsrc/suffix.h"
 #include "../alignsrc/align.h"
 #include "../iosrc/fileio.h"
+#include "latency.h"
+#include "readcache.h"
+#include "placement.h"
+#include "minimizer.h"
+#include "packed.h"
 
 
 // MAX LENGTH OF READ is assumed to be 512 here.  In the future this parameter should be discovered by
@@ -20,16 +26,246 @@
 #define LAMBDA				25
 
 
-// References the next index to insert into during the recursive
-// preparation of the tree.
-int nextindex;
+// Minimum identity (X) and coverage (Y) percentages for a read to be a hit.
+extern double X, Y;
 
-int *leafarray;
+// When to stop evaluating a read's candidate locations.
+#define EXIT_ALL			0	// Evaluate every candidate.
+#define EXIT_FIRST			1	// Stop at the first candidate that is a hit.
+#define EXIT_BEST			2	// Stop at the first perfect hit: the whole read, exactly.
+#define EXIT_TOP			3	// Stop once EXIT_N candidates have been hits.
 
+// Early-exit policy and the hit count EXIT_TOP waits for.
+extern int EXIT_POLICY, EXIT_N;
 
+// Reads seeded together by find_loc_batch, at most SEED_BATCH_MAX.  At 1,
+// each read is seeded on its own by find_loc_BF.
+#define SEED_BATCH_MAX		64
+extern int SEED_BATCH;
 
+// Edits (substitutions and indels) an approximate seed may have, 0 to only
+// seed exactly, and the steps find_loc_approx may take for one read.  Reads
+// without an exact seed longer than LAMBDA are seeded approximately.
+#define DEFAULT_APPROX_BUDGET	200000
+extern int APPROX_EDITS;
+extern long APPROX_BUDGET;
 
+// Index reads are seeded from, chosen when an index is built.
+#define SEEDS_TREE			0	// Longest exact match in the suffix tree.
+#define SEEDS_MINIMIZER		1	// Shared (w,k)-minimizers in a minimizer index.
+#define SEEDS_LAZY			2	// Longest exact match in a suffix tree expanded as seeds reach it.
+#define DEFAULT_MAX_OCC		200
 
+// Seeding index, minimizer k-mer length and window, and the most genome
+// occurrences a minimizer may have and still be used as an anchor.
+extern int SEED_INDEX, MINIMIZER_K, MINIMIZER_W, MAX_OCC;
+
+// Long reads, of any length, are mapped by chaining their exact matches with
+// the genome and aligning only the gaps between them, in memory linear in
+// the read.  From the tree, each LONG_CHUNK bases of the read are seeded on
+// their own; from minimizers, every shared minimizer is a match.
+#define LONG_CHUNK			100		// Read bases seeded together from the tree.
+#define LONG_BAND			16		// Diagonals either side of the path a gap is aligned within.
+#define LONG_MAX_GAP		5000	// Most read or genome bases between chained matches.
+#define LONG_LOOKBACK		64		// Preceding matches each match tries to chain onto.
+extern int LONG_READS;
+
+
+// Read-mapping index ============
+
+// An index owns the suffix tree built over one reference along with the leaf
+// array derived from it.  Indexes share no state, so several references can
+// be resident at once and mapped against concurrently.
+//
+// The tree is NULL when the index seeds from minimizers instead.  A lazy
+// tree's leaves are read from its own suffix array rather than the leaf
+// array, and it is never placed or replicated.
+//
+// In inverted mode the tree is built over the reads instead, as an index of
+// its own whose contigs are the reads, and the genome's index owns it.
+//
+// A reference may hold several contigs.  They are indexed as one genome with
+// a SEPARATOR between each, and contig k occupies
+// genome[contigstarts[k]: contigstarts[k+1] - 1].
+//
+// Genome positions are pos_t, 64 bits wide only in a LARGE_GENOME build.
+// The leaf array is bit-packed to as many bits as the genome length needs
+// either way.
+
+struct mapindex {
+	struct stree *tree;		// Suffix tree over the genome, NULL if seeding from minimizers.
+	struct minindex *minimizers;	// Minimizer index over the genome, NULL if seeding from the tree.
+	char *genome;			// Genome the tree was built over.
+	char **contignames;		// Name of each contig.
+	pos_t *contigstarts;	// Offset of each contig in the genome, plus one past the end.
+	int numcontigs;			// Number of contigs in the genome.
+	struct packed leafarray;	// Suffix numbers of the tree's leaves in depth-first order.
+	pos_t nextindex;		// Next index to insert into during preparation of the tree.
+	struct readcache *cache;	// Results of reads already mapped, NULL if not caching.
+	void *placed;			// Block holding the tree's nodes, leaf array and genome once placed, else NULL.
+	size_t placedbytes;		// Size of the placed block.
+	int backing;			// Page backing of the placed block (PAGES_*).
+	int node;				// NUMA node the index's memory was first touched on.
+	struct mapindex *primary;	// Index this one replicates, NULL unless a replica.
+	struct mapindex **replicas;	// Replica of the index on each NUMA node, NULL if not replicated.
+	struct topology *topo;	// Topology the replicas follow, NULL if not replicated.
+	struct mapindex *reads;	// Index over the reads in inverted mode, else NULL.
+};
+
+// ================================
+
+
+// Mapping results ================
+
+// Work done while seeding one read, for instrumentation.
+struct seedwork {
+	long nodes;				// Tree nodes visited.
+	long edges;				// Child edges compared while choosing a branch.
+};
+
+// Longest exact seed of a read, or the anchors found for it in a minimizer index.
+struct seed {
+	struct node *deepest;	// Deepest node matched; its leaves are the seed's locations.
+	int matches;			// Length of the seed.
+	int pos;				// Read position the seed starts at.
+	pos_t *locs;			// Genome positions of minimizer anchors, NULL for a tree seed.
+	int *locpos;			// Read position of each anchor.
+	int numlocs;			// Number of anchors.
+};
+
+// Best hit found for a single read, and the work it took to find it.
+struct hit {
+	int contig;				// Contig of the hit, -1 if the read did not map.
+	pos_t start;			// First position of the alignment within the contig.
+	pos_t end;				// Last+1 position of the alignment within the contig.
+	int locations;			// Number of locations the seed occurs at.
+	int candidates;			// Number of them evaluated before the exit policy stopped.
+	int ungapped;			// Number of them resolved by ungapped extension alone.
+	int fast;				// 1 if the hit was resolved by ungapped extension alone.
+	int cached;				// 1 if the result came from the index's read cache.
+	int approx;				// 1 if seeded approximately without a seed, 2 with one, else 0.
+	int anchors;			// Minimizer hits between the read and the genome.
+	int filtered;			// Read minimizers skipped for occurring more than MAX_OCC times.
+	double identity;		// Identity percentage of the hit.
+	double coverage;		// Percent of the read covered by the hit.
+	struct seedwork seed;	// Work done seeding the read.
+	WORK align;				// Work done aligning it, summed over candidates.
+	long seedns;			// Time spent seeding the read, in nanoseconds.
+	long alignns;			// Time spent aligning its candidates, in nanoseconds.
+};
+
+// Tallies for a batch of mapped reads.
+struct mapstats {
+	int reads;				// Number of reads mapped.
+	int hits;				// Number of reads with a hit.
+	int misses;				// Number of reads without one.
+	long locations;			// Number of seed locations found.
+	long alignments;		// Number of candidates evaluated.
+	long ungapped;			// Number of them resolved by ungapped extension alone.
+	int fastreads;			// Number of hits resolved by ungapped extension alone.
+	int cachehits;			// Number of reads answered from the read cache.
+	int approxreads;		// Number of reads without an exact seed seeded approximately.
+	int approxseeds;		// Number of them an approximate seed was found for.
+	int approxhits;			// Number of those that were hits.
+	long anchors;			// Minimizer hits between the reads and the genome.
+	long filtered;			// Read minimizers skipped for occurring too often.
+	long maximal;			// Maximal matches of the reads with the genome, in inverted mode.
+	long nodes;				// Tree nodes visited while seeding.
+	long edges;				// Child edges compared while seeding.
+	long cells;				// Dynamic programming cells computed.
+	long tracesteps;		// Traceback steps taken.
+	long maxnodes;			// Most tree nodes visited for one read.
+	long maxedges;			// Most child edges compared for one read.
+	long maxalignments;		// Most candidates aligned for one read.
+	long maxcells;			// Most cells computed for one read.
+	long tablebytes;		// Bytes held by the alignment table.
+	int node;				// NUMA node of the index replica mapped against.
+	struct memcounts memory;	// TLB and NUMA counts of the mapping thread.
+	struct histogram seedlat;	// Per-read seeding latency.
+	struct histogram alignlat;	// Per-read alignment latency.
+	struct histogram totallat;	// Per-read seeding plus alignment latency.
+};
+
+// Options for a command line mapping run.
+struct mapopts {
+	const char *metricsfile;	// File to export metrics to as JSON, or NULL.
+	const char *slowfile;		// File to write the slowest reads to, or NULL.
+	int slowcount;				// Number of slowest reads to keep.
+	int cacheentries;			// Reads the duplicate-read cache holds, 0 for no cache.
+	int pages;					// Page backing to place the index on (PAGES_*), -1 to leave it.
+	int numa;					// 1 to replicate the index on every NUMA node.
+	int inverted;				// 1 to index the reads and stream the genome past them.
+};
+
+// ================================
+
+
+// Interface Prototypes ===========
+
+// Return an index owning the given genome and contig table, with nothing built over it.
+struct mapindex *new_index (char*, char**, pos_t*, int);
+// Build the suffix tree, or minimizer index, for the given genome and contig table;
+// the index takes ownership of them.
+struct mapindex *build_index (char*, char**, pos_t*, int, char*);
+// Build the suffix tree over every read in the read file, as an index whose contigs
+// are the reads.  Return NULL if the file holds no reads.
+struct mapindex *build_read_index (const char*, char*);
+// Find the contig holding the given genome position.
+int find_contig (struct mapindex*, pos_t);
+// Suffix number of the leaf at the given place in the tree's depth-first order.
+pos_t get_leaf (struct mapindex*, pos_t);
+// Prepare the index's tree for mapping by recording the leaf list of each node.
+void prepare_tree (struct mapindex*);
+// Cache the results of reads mapped against an index, up to the given number of reads.
+void enable_cache (struct mapindex*, int);
+// Move an index's tree nodes, leaf array and genome into one block with the given page backing.
+void place_index (struct mapindex*, int);
+// Replicate a placed index onto every other NUMA node.  Return the number of nodes.
+int replicate_index (struct mapindex*, int);
+// Return the replica of an index nearest the calling thread, or the index itself.
+struct mapindex *nearest_index (struct mapindex*);
+// Bytes of an index's tree nodes, leaf array and genome, and how many are on huge pages.
+long index_bytes (struct mapindex*);
+long index_huge_bytes (struct mapindex*);
+// Free an index along with its tree, leaf array, genome, cache, and replicas.
+void free_index (struct mapindex*);
+// Find the deepest node matching a substring of the read and the read position the match
+// starts at, brute force and optimized versions.
+struct node *find_loc_BF (struct mapindex*, int, char*, int*, int*, struct seedwork*);
+struct node *find_loc (struct mapindex*, int, char*, int*, int*, struct seedwork*);
+// As find_loc_BF, allowing the seed up to APPROX_EDITS substitutions and indels.
+struct node *find_loc_approx (struct mapindex*, int, char*, int*, int*, struct seedwork*);
+// Find the candidate locations of a read from its minimizers.
+void find_loc_minimizers (struct mapindex*, char*, struct seed*, struct hit*);
+// Seed a batch of reads as find_loc_BF does, interleaving their tree walks.
+void find_loc_batch (struct mapindex*, int, char**, struct seed*, struct seedwork*);
+// Set the early-exit policy from its name: all, first, best, or top<N>.  Return 0
+// if the name is not recognised.
+int set_exit_policy (const char*);
+// Map a single read onto the index, recording its best hit.  Return 1 if it mapped.
+int map_read (struct mapindex*, char*, DPTABLE*, struct hit*);
+// Map a read of any length by chaining its exact matches, recording its hit.  Return 1
+// if it mapped.
+int map_long_read (struct mapindex*, char*, DPTABLE*, struct hit*);
+// Map a batch of reads, recording each read's best hit.  Return the number that mapped.
+int map_batch (struct mapindex*, int, char**, DPTABLE*, struct hit*);
+// Map every read from an open stream onto the index, SEED_BATCH at a time or one
+// at a time as long reads, writing one line per read, and offer each read to
+// the slow-read tracker unless it is NULL.
+void map_read_file (struct mapindex*, FILE*, FILE*, struct mapstats*, struct slowreads*);
+// Map every read in the read file onto the index, writing hits to the write file.
+void map_reads (struct mapindex*, const char*, const char*, struct mapstats*, struct slowreads*);
+// Print the results of a mapping run.
+void print_results (struct mapindex*, struct mapstats*);
+// Map the reads of the index's read index by streaming the genome past them,
+// writing hits to the write file.
+void map_reads_inverted (struct mapindex*, const char*, struct mapstats*, struct slowreads*);
+// Write the mapping counters, stage times, and memory use as JSON to the given file.
+void write_metrics (const char*, struct mapindex*, struct mapstats*, double*);
+// Build, prepare, and map reads against the given genome, reporting timings,
+// and exporting metrics and slow reads as the options request.
+void exec_mapread (const char*, const char*, const char*, struct mapopts*);
+void print_usage_and_exit ();
 
 
 #endif
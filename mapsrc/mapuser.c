@@ -3,17 +3,104 @@
 // MAIN BLOCK
 
 #include "mapread.h"
+#include "server.h"
 
 int main (int argc, char *argv[])
 // Get it!
 {
-	if (argc != 4) {
-		print_usage_and_exit ();
+	struct mapopts opts = { NULL, NULL, 0, DEFAULT_CACHE_ENTRIES, -1, 0, 0 };
+	int cache = 0;
+
+	if (argc >= 2 && strcmp (argv[1], "--client") == 0) {
+		// Submit a job to a running server.
+		if (argc != 4 && argc != 5) print_usage_and_exit ();
+		return run_client (argv[2], argv[3], (argc == 5)? argv[4] : NULL);
+	} else if (argc == 3 && strcmp (argv[1], "--stop") == 0) {
+		return stop_server (argv[2]);
+	}
+
+	// Options come first, and apply to a server as well as a single run,
+	// except those the server cannot honour, rejected below.
+	while (argc > 4 && strcmp (argv[1], "--serve") != 0) {
+		if (strcmp (argv[1], "--metrics") == 0) {
+			opts.metricsfile = argv[2];
+			argc -= 2; argv += 2;
+		} else if (strcmp (argv[1], "--batch") == 0 && atoi (argv[2]) > 0
+					&& atoi (argv[2]) <= SEED_BATCH_MAX) {
+			SEED_BATCH = atoi (argv[2]);
+			argc -= 2; argv += 2;
+		} else if (strcmp (argv[1], "--cache") == 0 && atoi (argv[2]) >= 0) {
+			opts.cacheentries = atoi (argv[2]);
+			cache = 1;
+			argc -= 2; argv += 2;
+		} else if (strcmp (argv[1], "--exit") == 0 && set_exit_policy (argv[2])) {
+			argc -= 2; argv += 2;
+		} else if (strcmp (argv[1], "--pages") == 0 && parse_pages (argv[2]) >= 0) {
+			opts.pages = parse_pages (argv[2]);
+			argc -= 2; argv += 2;
+		} else if (strcmp (argv[1], "--approx") == 0 && atoi (argv[2]) >= 0) {
+			APPROX_EDITS = atoi (argv[2]);
+			argc -= 2; argv += 2;
+		} else if (strcmp (argv[1], "--approx-budget") == 0 && atol (argv[2]) > 0) {
+			APPROX_BUDGET = atol (argv[2]);
+			argc -= 2; argv += 2;
+		} else if (strcmp (argv[1], "--seeds") == 0 && strcmp (argv[2], "tree") == 0) {
+			SEED_INDEX = SEEDS_TREE;
+			argc -= 2; argv += 2;
+		} else if (strcmp (argv[1], "--seeds") == 0 && strcmp (argv[2], "minimizer") == 0) {
+			SEED_INDEX = SEEDS_MINIMIZER;
+			argc -= 2; argv += 2;
+		} else if (strcmp (argv[1], "--seeds") == 0 && strcmp (argv[2], "lazy") == 0) {
+			SEED_INDEX = SEEDS_LAZY;
+			argc -= 2; argv += 2;
+		} else if (argc > 5 && strcmp (argv[1], "--minimizer") == 0
+					&& atoi (argv[2]) > 0 && atoi (argv[2]) <= MAX_MINIMIZER_K
+					&& atoi (argv[3]) > 0 && atoi (argv[3]) <= MAX_MINIMIZER_W) {
+			MINIMIZER_K = atoi (argv[2]);
+			MINIMIZER_W = atoi (argv[3]);
+			argc -= 3; argv += 3;
+		} else if (strcmp (argv[1], "--max-occ") == 0 && atoi (argv[2]) > 0) {
+			MAX_OCC = atoi (argv[2]);
+			argc -= 2; argv += 2;
+		} else if (strcmp (argv[1], "--long") == 0) {
+			LONG_READS = 1;
+			argc -= 1; argv += 1;
+		} else if (strcmp (argv[1], "--inverted") == 0) {
+			opts.inverted = 1;
+			argc -= 1; argv += 1;
+		} else if (strcmp (argv[1], "--inflate-threads") == 0 && atoi (argv[2]) > 0
+					&& atoi (argv[2]) <= INFLATE_THREADS_MAX) {
+			INFLATE_THREADS = atoi (argv[2]);
+			argc -= 2; argv += 2;
+		} else if (strcmp (argv[1], "--numa") == 0) {
+			opts.numa = 1;
+			argc -= 1; argv += 1;
+		} else if (argc > 5 && strcmp (argv[1], "--slow") == 0 && atoi (argv[2]) > 0) {
+			opts.slowcount = atoi (argv[2]);
+			opts.slowfile = argv[3];
+			argc -= 3; argv += 3;
+		} else {
+			print_usage_and_exit ();
+		}
+	}
+	if (argc == 5 && strcmp (argv[1], "--serve") == 0) {
+		// A server keeps the genome's index resident; it cannot index reads.
+		// It reports each job's metrics and latency to its client, not to files.
+		if (opts.inverted || opts.metricsfile || opts.slowfile) print_usage_and_exit ();
+		read_parms ("INPUTS/parameters.config");
+
+		// Keep the index resident and serve mapping jobs.
+		serve_mapread (argv[2], argv[3], argv[4], &opts);
 	} else {
+		// Inverted mode seeds from its own tree over the reads, exactly.
+		if (argc != 4 || (opts.inverted && (LONG_READS || SEED_INDEX != SEEDS_TREE
+												|| APPROX_EDITS || cache))) {
+			print_usage_and_exit ();
+		}
 		read_parms ("INPUTS/parameters.config");
 		
 		// Execute the read mapping algorithm.
-		exec_mapread (argv[1], argv[2], argv[3]);
+		exec_mapread (argv[1], argv[2], argv[3], &opts);
 	}
 	return 0;
-}
\ No newline at end of file
+}
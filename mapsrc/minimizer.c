@@ -0,0 +1,192 @@
+#include "minimizer.h"
+
+
+// ============================================================================
+// minimizer.c implements the minimizer index.  k-mers are packed two bits a
+// base and hashed with an invertible mix, so that distinct k-mers never
+// collide and minimizers are spread evenly rather than favouring runs of A.
+// Bases outside ACGT, such as the separators between contigs, break the
+// sequence: no k-mer spans them.
+// ============================================================================
+
+
+int base_code (char c)
+// Two-bit code of a base, -1 for anything else.
+{
+	switch (c) {
+		case 'A': case 'a': return 0;
+		case 'C': case 'c': return 1;
+		case 'G': case 'g': return 2;
+		case 'T': case 't': return 3;
+	}
+	return -1;
+}
+
+
+unsigned long hash_kmer (unsigned long key, unsigned long mask)
+// Invertible hash of a packed k-mer within mask (Thomas Wang's 64-bit mix).
+{
+	key = (~key + (key << 21)) & mask;
+	key = key ^ key >> 24;
+	key = ((key + (key << 3)) + (key << 8)) & mask;
+	key = key ^ key >> 14;
+	key = ((key + (key << 2)) + (key << 4)) & mask;
+	key = key ^ key >> 28;
+	key = (key + (key << 31)) & mask;
+	return key;
+}
+
+
+void push_minimizer (struct minimizer **mins, long *cap, long *n, unsigned long hash, pos_t pos)
+// Append a minimizer, growing the array as needed.
+{
+	if (*n == *cap) {
+		*cap = (*cap)? 2 * *cap : 1024;
+		*mins = (struct minimizer*) realloc (*mins, sizeof (struct minimizer) * *cap);
+		if (!*mins) {
+			perror ("Unable to allocate minimizers");
+			exit (1);
+		}
+	}
+	(*mins)[*n].hash = hash;
+	(*mins)[*n].pos = pos;
+	++*n;
+}
+
+
+long find_minimizers (const char *s, pos_t len, int k, int w, struct minimizer **mins, long *cap)
+// Find the minimizers of s[0: len]: for every window of w consecutive k-mers,
+// the k-mer of smallest hash, the leftmost on a tie.  Each is recorded once,
+// however many windows it is the minimum of.  mins is grown with realloc
+// from the given capacity, which is updated.  Return the number found.
+{
+	unsigned long kmer = 0, mask = (k < 32)? (1UL << (2 * k)) - 1 : ~0UL;
+	unsigned long ring[MAX_MINIMIZER_W];
+	pos_t i, j, best = -1, last = -1;
+	long n = 0;
+	int c, valid = 0;
+
+	for (i = 0; i < len; ++i) {
+		if ((c = base_code (s[i])) < 0) {
+			valid = 0;		// Restart after any other character.
+			best = -1;
+			continue;
+		}
+		kmer = ((kmer << 2) | c) & mask;
+		if (++valid < k) continue;
+
+		// The k-mer ending at i starts at i - k + 1; ring holds the hashes of
+		// the window's k-mers by start position.
+		ring[(i - k + 1) % w] = hash_kmer (kmer, mask);
+		if (valid < k + w - 1) continue;
+
+		// The window holds the k-mers starting in [i - k - w + 2, i - k + 1].
+		if (best < i - k - w + 2) {
+			// The minimum slid out of the window: rescan it.
+			best = i - k - w + 2;
+			for (j = best + 1; j <= i - k + 1; ++j) {
+				if (ring[j % w] < ring[best % w]) best = j;
+			}
+		} else if (ring[(i - k + 1) % w] < ring[best % w]) {
+			best = i - k + 1;
+		}
+		if (best != last) {
+			push_minimizer (mins, cap, &n, ring[best % w], best);
+			last = best;
+		}
+	}
+	return n;
+}
+
+
+int compare_minimizers (const void *a, const void *b)
+// Order minimizers by hash, then position.
+{
+	const struct minimizer *x = (const struct minimizer*) a, *y = (const struct minimizer*) b;
+	if (x -> hash != y -> hash) return (x -> hash < y -> hash)? -1 : 1;
+	return (x -> pos > y -> pos) - (x -> pos < y -> pos);
+}
+
+
+struct minslot *find_slot (struct minindex *mi, unsigned long hash)
+// Return the slot holding a minimizer, or the empty slot it would go in.
+{
+	long s = (hash * 0x9e3779b97f4a7c15UL) & (mi -> tablesize - 1);
+	while (mi -> table[s].count && mi -> table[s].hash != hash) {
+		s = (s + 1) & (mi -> tablesize - 1);
+	}
+	return &mi -> table[s];
+}
+
+
+struct minindex *build_minindex (const char *s, pos_t len, int k, int w)
+// Index the minimizers of s[0: len]: sort them by hash, keep their positions
+// in that order, and record each distinct minimizer's run of positions in a
+// hash table at most two-thirds full.
+{
+	struct minimizer *mins = NULL;
+	struct minindex *mi;
+	struct minslot *slot;
+	long n, cap = 0, j, run;
+
+	mi = (struct minindex*) calloc (1, sizeof (struct minindex));
+	if (!mi) {
+		perror ("Unable to allocate minimizer index");
+		exit (1);
+	}
+	mi -> k = k;
+	mi -> w = w;
+	n = find_minimizers (s, len, k, w, &mins, &cap);
+	qsort (mins, n, sizeof (struct minimizer), compare_minimizers);
+
+	mi -> numpositions = n;
+	mi -> positions = (pos_t*) malloc (sizeof (pos_t) * ((n)? n : 1));
+	for (j = 0; j < n; ++j) {
+		mi -> positions[j] = mins[j].pos;
+		if (j == 0 || mins[j].hash != mins[j - 1].hash) ++mi -> numkeys;
+	}
+	for (mi -> tablesize = 16; mi -> tablesize < mi -> numkeys * 3 / 2; mi -> tablesize *= 2);
+	mi -> table = (struct minslot*) calloc (mi -> tablesize, sizeof (struct minslot));
+	if (!mi -> positions || !mi -> table) {
+		perror ("Unable to allocate minimizer index");
+		exit (1);
+	}
+	for (j = 0; j < n; j += run) {
+		for (run = 1; j + run < n && mins[j + run].hash == mins[j].hash; ++run);
+		slot = find_slot (mi, mins[j].hash);
+		slot -> hash = mins[j].hash;
+		slot -> offset = j;
+		slot -> count = run;
+	}
+	free (mins);
+	return mi;
+}
+
+
+pos_t *lookup_minimizer (struct minindex *mi, unsigned long hash, long *count)
+// Return the genome positions of a minimizer, in increasing order, and set
+// count to their number.  Return NULL, with count 0, if it does not occur.
+{
+	struct minslot *slot = find_slot (mi, hash);
+	*count = slot -> count;
+	return (slot -> count)? &mi -> positions[slot -> offset] : NULL;
+}
+
+
+long minindex_bytes (struct minindex *mi)
+// Bytes allocated to the index's table and positions.
+{
+	return sizeof (struct minindex) + mi -> tablesize * sizeof (struct minslot)
+			+ mi -> numpositions * sizeof (pos_t);
+}
+
+
+void free_minindex (struct minindex *mi)
+// Release a minimizer index.
+{
+	if (mi) {
+		free (mi -> table);
+		free (mi -> positions);
+		free (mi);
+	}
+}
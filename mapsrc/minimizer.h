@@ -0,0 +1,65 @@
+#ifndef MINIMIZER_H_
+#define MINIMIZER_H_
+
+
+// ============================================================================
+// minimizer.h declares the minimizer index, a lighter alternative to the
+// suffix tree for seeding.  Of every w consecutive k-mers of the genome only
+// the one with the smallest hash, its (w,k)-minimizer, is kept, in a hash
+// table from minimizer to the genome positions it occurs at.  A read's own
+// minimizers then find the genome positions it shares k-mers with.  The index
+// holds about 2/(w+1) positions per base, against the suffix tree's two nodes.
+// ============================================================================
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../sfxsrc/suffix.h"
+
+
+#define DEFAULT_MINIMIZER_K		15
+#define DEFAULT_MINIMIZER_W		10
+#define MAX_MINIMIZER_K			31		// k-mers are packed two bits a base into 64 bits.
+#define MAX_MINIMIZER_W			256
+
+
+// One minimizer of a sequence.
+struct minimizer {
+	unsigned long hash;		// Hash of the k-mer.
+	pos_t pos;				// Position of the k-mer's first base in the sequence.
+};
+
+// Slot of the minimizer hash table.
+struct minslot {
+	unsigned long hash;		// Minimizer hash.
+	long offset;			// First of its positions in the position array.
+	long count;				// Number of positions, 0 for an empty slot.
+};
+
+// Genome positions of every minimizer, grouped by minimizer.
+struct minindex {
+	int k, w;				// k-mer length and window of k-mers.
+	long numkeys;			// Distinct minimizers.
+	long tablesize;			// Slots in the hash table, a power of two.
+	struct minslot *table;	// Open-addressed table of minimizers.
+	pos_t *positions;		// Genome positions, grouped by minimizer.
+	long numpositions;		// Number of positions.
+};
+
+
+// Interface Prototypes ===========
+
+// Find the (w,k)-minimizers of a sequence into a growable array, given its
+// capacity.  Return the number found.
+long find_minimizers (const char*, pos_t, int, int, struct minimizer**, long*);
+// Build the minimizer index of a sequence.
+struct minindex *build_minindex (const char*, pos_t, int, int);
+// Return the positions of a minimizer and set their count, NULL if it does not occur.
+pos_t *lookup_minimizer (struct minindex*, unsigned long, long*);
+// Bytes allocated to a minimizer index.
+long minindex_bytes (struct minindex*);
+void free_minindex (struct minindex*);
+
+
+#endif
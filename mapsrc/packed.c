@@ -0,0 +1,71 @@
+#include "packed.h"
+
+
+// ============================================================================
+// packed.c implements bit-packed arrays.  An entry may straddle two words;
+// the spare word at the end means the word after an entry's first always
+// exists, so reads never need to check.
+// ============================================================================
+
+
+int packed_bits (unsigned long max)
+// Bits needed to hold every value up to max, at least one.
+{
+	int bits = 1;
+	while (bits < 64 && max >> bits) ++bits;
+	return bits;
+}
+
+
+void init_packed (struct packed *p, long length, int bits)
+// Allocate a zeroed packed array of length entries of the given bits.
+{
+	p -> length = length;
+	p -> bits = bits;
+	p -> mask = (bits < 64)? (1UL << bits) - 1 : ~0UL;
+	p -> words = (unsigned long*) calloc (packed_bytes (p) / sizeof (unsigned long),
+											sizeof (unsigned long));
+	if (!p -> words) {
+		perror ("Unable to allocate packed array");
+		exit (1);
+	}
+}
+
+
+unsigned long packed_get (const struct packed *p, long k)
+// Return entry k.  The high part comes from the next word, shifted in two
+// steps so that an entry starting at bit 0 shifts it out entirely rather
+// than by the undefined full width.
+{
+	unsigned long bit = (unsigned long) k * p -> bits, word = bit >> 6, off = bit & 63;
+	return ((p -> words[word] >> off) | ((p -> words[word + 1] << 1) << (63 - off))) & p -> mask;
+}
+
+
+void packed_set (struct packed *p, long k, unsigned long value)
+// Set entry k to value, which must fit in the array's bits.
+{
+	unsigned long bit = (unsigned long) k * p -> bits, word = bit >> 6, off = bit & 63;
+
+	p -> words[word] = (p -> words[word] & ~(p -> mask << off)) | (value << off);
+	if (off + p -> bits > 64) {
+		p -> words[word + 1] = (p -> words[word + 1] & ~(p -> mask >> (64 - off)))
+								| (value >> (64 - off));
+	}
+}
+
+
+size_t packed_bytes (const struct packed *p)
+// Bytes held by the array's words, the spare one included.
+{
+	return ((p -> length * p -> bits + 63) / 64 + 1) * sizeof (unsigned long);
+}
+
+
+void free_packed (struct packed *p)
+// Release a packed array's words.
+{
+	free (p -> words);
+	p -> words = NULL;
+	p -> length = 0;
+}
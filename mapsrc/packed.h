@@ -0,0 +1,42 @@
+#ifndef PACKED_H_
+#define PACKED_H_
+
+
+// ============================================================================
+// packed.h declares bit-packed arrays of unsigned integers.  Every entry takes
+// the same number of bits, as few as the largest value needs, laid end to end
+// across 64-bit words, so an array of positions below n costs ceil(log2 n)
+// bits an entry rather than a whole int or long.  An entry is read with two
+// word loads and shifts, without branching.
+// ============================================================================
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+// A bit-packed array.
+struct packed {
+	unsigned long *words;	// Entries from the low bit of words[0] up, plus one spare word.
+	long length;			// Number of entries.
+	int bits;				// Bits per entry, 1 to 64.
+	unsigned long mask;		// The low bits bits set.
+};
+
+
+// Interface Prototypes ===========
+
+// Bits needed to hold every value up to the given one.
+int packed_bits (unsigned long);
+// Allocate a zeroed packed array of the given length and bits per entry.
+void init_packed (struct packed*, long, int);
+// Read and write one entry.
+unsigned long packed_get (const struct packed*, long);
+void packed_set (struct packed*, long, unsigned long);
+// Bytes held by a packed array's words.
+size_t packed_bytes (const struct packed*);
+void free_packed (struct packed*);
+
+
+#endif
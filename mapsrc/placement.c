@@ -0,0 +1,308 @@
+#define _GNU_SOURCE
+#include "placement.h"
+#include <sched.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+
+// ============================================================================
+// placement.c implements page backing, NUMA topology, thread pinning, and
+// the TLB and remote-access counters.  Every piece degrades quietly: a
+// kernel without huge pages, NUMA, or accessible performance counters gives
+// ordinary pages, one node, and counts marked invalid.
+// ============================================================================
+
+
+size_t placed_size (size_t bytes)
+// Round an allocation up to whole huge pages.
+{
+	return (bytes + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+}
+
+
+void *map_aligned (size_t size)
+// Map anonymous memory aligned to a huge page, so that the kernel can back
+// all of it with huge pages.
+{
+	char *mem, *aligned;
+	size_t head;
+
+	mem = mmap (NULL, size + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE,
+				MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (mem == MAP_FAILED) return NULL;
+	aligned = (char*) (((unsigned long) mem + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1));
+	head = aligned - mem;
+	if (head) munmap (mem, head);
+	munmap (aligned + size, HUGE_PAGE_SIZE - head);
+	return aligned;
+}
+
+
+void *alloc_placed (size_t bytes, int pages, int *backing)
+// Allocate zeroed, huge-page-aligned memory backed as pages asks and record
+// the backing obtained: explicit huge pages fall back to transparent ones if
+// the hugetlbfs pool cannot supply them.  Pages are not touched here, so
+// they land on the NUMA node of the thread that first writes them.
+{
+	size_t size = placed_size (bytes);
+	void *mem = MAP_FAILED;
+
+	*backing = PAGES_NORMAL;
+	if (pages == PAGES_HUGETLB) {
+		mem = mmap (NULL, size, PROT_READ | PROT_WRITE,
+					MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+		if (mem != MAP_FAILED) *backing = PAGES_HUGETLB;
+	}
+	if (mem == MAP_FAILED) {
+		mem = map_aligned (size);
+		if (!mem) {
+			perror ("Unable to allocate placed memory");
+			exit (1);
+		}
+		if (pages != PAGES_NORMAL && !madvise (mem, size, MADV_HUGEPAGE)) {
+			*backing = PAGES_THP;
+		}
+	}
+	return mem;
+}
+
+
+void free_placed (void *mem, size_t bytes)
+// Release memory from alloc_placed.
+{
+	if (mem) munmap (mem, placed_size (bytes));
+}
+
+
+long huge_bytes (void *mem, size_t bytes)
+// Return the bytes of [mem, mem + bytes) the kernel reports as backed by
+// huge pages, transparent or explicit, or -1 if /proc/self/smaps cannot be
+// read.
+{
+	char line[256];
+	unsigned long lo, hi, start = (unsigned long) mem, end = start + bytes;
+	long kb, total = 0;
+	int inside = 0;
+	FILE *fp = fopen ("/proc/self/smaps", "r");
+
+	if (!fp) return -1;
+	while (fgets (line, sizeof (line), fp)) {
+		if (sscanf (line, "%lx-%lx ", &lo, &hi) == 2) {
+			inside = lo < end && hi > start;
+		} else if (inside && (sscanf (line, "AnonHugePages: %ld kB", &kb) == 1
+								|| sscanf (line, "Private_Hugetlb: %ld kB", &kb) == 1
+								|| sscanf (line, "Shared_Hugetlb: %ld kB", &kb) == 1)) {
+			total += kb * 1024;
+		}
+	}
+	fclose (fp);
+	return total;
+}
+
+
+const char *pages_name (int pages)
+// Name of a page backing.
+{
+	switch (pages) {
+		case PAGES_THP: return "thp";
+		case PAGES_HUGETLB: return "hugetlb";
+	}
+	return "normal";
+}
+
+
+int parse_pages (const char *name)
+// Parse a page backing from its name.  Return -1 if it is not one.
+{
+	if (strcmp (name, "normal") == 0) return PAGES_NORMAL;
+	if (strcmp (name, "thp") == 0) return PAGES_THP;
+	if (strcmp (name, "hugetlb") == 0) return PAGES_HUGETLB;
+	return -1;
+}
+
+
+// ============================================================================
+// Topology and pinning
+// ============================================================================
+
+
+int parse_cpulist (const char *list, unsigned long *mask)
+// Set the bits of mask for a kernel CPU list such as "0-3,8-11".  Return
+// the number of CPUs listed.
+{
+	int lo, hi, cpu, count = 0, used;
+	while (sscanf (list, "%d%n", &lo, &used) == 1) {
+		list += used;
+		hi = lo;
+		if (*list == '-' && sscanf (list + 1, "%d%n", &hi, &used) == 1) list += used + 1;
+		for (cpu = lo; cpu <= hi && cpu < MAX_CPUS; ++cpu) {
+			mask[cpu / (8 * sizeof (unsigned long))] |= 1UL << (cpu % (8 * sizeof (unsigned long)));
+			++count;
+		}
+		if (*list != ',') break;
+		++list;
+	}
+	return count;
+}
+
+
+void read_topology (struct topology *topo)
+// Read the nodes that have CPUs from /sys.  Without NUMA, or without /sys,
+// the machine is one node holding every CPU the process may run on.
+{
+	char path[128], list[4096];
+	cpu_set_t set;
+	FILE *fp;
+	int id, cpu;
+
+	memset (topo, 0, sizeof (struct topology));
+	for (id = 0; id < 1024 && topo -> numnodes < MAX_NUMA_NODES; ++id) {
+		snprintf (path, sizeof (path), "/sys/devices/system/node/node%d/cpulist", id);
+		if (!(fp = fopen (path, "r"))) continue;
+		if (fgets (list, sizeof (list), fp) && parse_cpulist (list, topo -> cpus[topo -> numnodes])) {
+			topo -> ids[topo -> numnodes++] = id;
+		}
+		fclose (fp);
+	}
+	if (!topo -> numnodes) {
+		topo -> numnodes = 1;
+		topo -> ids[0] = 0;
+		memset (topo -> cpus[0], 0, sizeof (topo -> cpus[0]));
+		if (!sched_getaffinity (0, sizeof (set), &set)) {
+			for (cpu = 0; cpu < MAX_CPUS && cpu < CPU_SETSIZE; ++cpu) {
+				if (CPU_ISSET (cpu, &set)) {
+					topo -> cpus[0][cpu / (8 * sizeof (unsigned long))] |=
+							1UL << (cpu % (8 * sizeof (unsigned long)));
+				}
+			}
+		}
+	}
+}
+
+
+int node_has_cpu (struct topology *topo, int node, int cpu)
+// Return 1 if the given CPU belongs to the given node.
+{
+	return cpu >= 0 && cpu < MAX_CPUS
+			&& (topo -> cpus[node][cpu / (8 * sizeof (unsigned long))]
+				>> (cpu % (8 * sizeof (unsigned long)))) & 1;
+}
+
+
+int pin_to_node (struct topology *topo, int node)
+// Pin the calling thread to the CPUs of the given node.  Return 0 on
+// success, nonzero if the kernel refused.
+{
+	cpu_set_t set;
+	int cpu;
+
+	CPU_ZERO (&set);
+	for (cpu = 0; cpu < MAX_CPUS && cpu < CPU_SETSIZE; ++cpu) {
+		if (node_has_cpu (topo, node, cpu)) CPU_SET (cpu, &set);
+	}
+	return pthread_setaffinity_np (pthread_self (), sizeof (set), &set);
+}
+
+
+int current_node (struct topology *topo)
+// Return the node of the CPU the calling thread is running on, 0 if unknown.
+{
+	int node, cpu = sched_getcpu ();
+	for (node = 0; node < topo -> numnodes; ++node) {
+		if (node_has_cpu (topo, node, cpu)) return node;
+	}
+	return 0;
+}
+
+
+// ============================================================================
+// Memory counters
+// ============================================================================
+
+// The generic cache events: DTLB load lookups and misses, and loads served
+// by a NUMA node, of which misses are those served by a remote one.
+#define COUNTER(cache, result)	((cache) | (PERF_COUNT_HW_CACHE_OP_READ << 8) | ((result) << 16))
+
+static const unsigned long counter_events[4] = {
+	COUNTER (PERF_COUNT_HW_CACHE_DTLB, PERF_COUNT_HW_CACHE_RESULT_ACCESS),
+	COUNTER (PERF_COUNT_HW_CACHE_DTLB, PERF_COUNT_HW_CACHE_RESULT_MISS),
+	COUNTER (PERF_COUNT_HW_CACHE_NODE, PERF_COUNT_HW_CACHE_RESULT_ACCESS),
+	COUNTER (PERF_COUNT_HW_CACHE_NODE, PERF_COUNT_HW_CACHE_RESULT_MISS),
+};
+
+
+void start_memcounters (struct memcounters *counters)
+// Open and start the calling thread's counters, counting user space only so
+// that the default perf_event_paranoid setting allows them.
+{
+	struct perf_event_attr attr;
+	int k;
+
+	for (k = 0; k < 4; ++k) {
+		memset (&attr, 0, sizeof (attr));
+		attr.type = PERF_TYPE_HW_CACHE;
+		attr.size = sizeof (attr);
+		attr.config = counter_events[k];
+		attr.disabled = 1;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+		counters -> fd[k] = syscall (SYS_perf_event_open, &attr, 0, -1, -1, 0);
+		if (counters -> fd[k] >= 0) {
+			ioctl (counters -> fd[k], PERF_EVENT_IOC_RESET, 0);
+			ioctl (counters -> fd[k], PERF_EVENT_IOC_ENABLE, 0);
+		}
+	}
+}
+
+
+long read_counter (int fd)
+// Read and close one counter, scaled up for any time the kernel had it
+// switched out to share the hardware.  Return -1 if it cannot be read.
+{
+	unsigned long values[3];
+	long count = -1;
+
+	if (fd < 0) return -1;
+	ioctl (fd, PERF_EVENT_IOC_DISABLE, 0);
+	if (read (fd, values, sizeof (values)) == sizeof (values) && values[2]) {
+		count = (long) ((double) values[0] * values[1] / values[2]);
+	}
+	close (fd);
+	return count;
+}
+
+
+void stop_memcounters (struct memcounters *counters, struct memcounts *counts)
+// Stop the calling thread's counters and store what they counted.
+{
+	long values[4];
+	int k;
+
+	for (k = 0; k < 4; ++k) {
+		values[k] = read_counter (counters -> fd[k]);
+		counters -> fd[k] = -1;
+	}
+	counts -> dtlbvalid = values[0] >= 0 && values[1] >= 0;
+	counts -> nodevalid = values[2] >= 0 && values[3] >= 0;
+	counts -> dtlbloads = (counts -> dtlbvalid)? values[0] : 0;
+	counts -> dtlbmisses = (counts -> dtlbvalid)? values[1] : 0;
+	counts -> nodeloads = (counts -> nodevalid)? values[2] : 0;
+	counts -> nodemisses = (counts -> nodevalid)? values[3] : 0;
+}
+
+
+void add_memcounts (struct memcounts *into, struct memcounts *from)
+// Fold one set of counts into another.  A total is only valid if every part was.
+{
+	into -> dtlbvalid = into -> dtlbvalid && from -> dtlbvalid;
+	into -> nodevalid = into -> nodevalid && from -> nodevalid;
+	into -> dtlbloads += from -> dtlbloads;
+	into -> dtlbmisses += from -> dtlbmisses;
+	into -> nodeloads += from -> nodeloads;
+	into -> nodemisses += from -> nodemisses;
+}
@@ -0,0 +1,78 @@
+#ifndef PLACEMENT_H_
+#define PLACEMENT_H_
+
+
+// ============================================================================
+// placement.h declares the memory placement helpers for large indexes: page
+// backing (ordinary, transparent huge, or explicit huge pages), the NUMA
+// topology as the kernel reports it under /sys, thread pinning, and the
+// hardware counters that show how well placement worked (TLB misses and
+// remote-node memory accesses).  Nothing here needs libnuma; memory lands on
+// the node of the thread that first touches it.
+// ============================================================================
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+// Page backing for placed memory.
+#define PAGES_NORMAL		0	// Ordinary pages.
+#define PAGES_THP			1	// Transparent huge pages, as the kernel can find them.
+#define PAGES_HUGETLB		2	// Explicit huge pages from the hugetlbfs pool, else THP.
+
+#define HUGE_PAGE_SIZE		(2UL << 20)
+#define MAX_NUMA_NODES		64
+#define MAX_CPUS			1024
+#define CPU_WORDS			(MAX_CPUS / (8 * sizeof (unsigned long)))
+
+
+// NUMA nodes with CPUs, as listed under /sys/devices/system/node.
+struct topology {
+	int numnodes;						// Nodes with at least one CPU; 1 without NUMA.
+	int ids[MAX_NUMA_NODES];			// Kernel's id for each node.
+	unsigned long cpus[MAX_NUMA_NODES][CPU_WORDS];	// Bitmask of the CPUs of each node.
+};
+
+// Hardware counts of the memory behaviour of one thread.
+struct memcounts {
+	int dtlbvalid;			// 1 if the data TLB counters could be read.
+	int nodevalid;			// 1 if the NUMA node counters could be read.
+	long dtlbloads;			// Data TLB load lookups.
+	long dtlbmisses;		// Of those, misses.
+	long nodeloads;			// Loads served from memory.
+	long nodemisses;		// Of those, served by a remote node.
+};
+
+// Open counters for the calling thread; -1 where unavailable.
+struct memcounters {
+	int fd[4];
+};
+
+
+// Interface Prototypes ===========
+
+// Allocate zeroed memory backed as asked, recording the backing obtained.
+void *alloc_placed (size_t, int, int*);
+void free_placed (void*, size_t);
+// Bytes of the given range currently backed by huge pages, -1 if unknown.
+long huge_bytes (void*, size_t);
+// Name of a page backing.
+const char *pages_name (int);
+// Parse a page backing from its name: normal, thp, or hugetlb.  Return -1 if unknown.
+int parse_pages (const char*);
+// Read the NUMA topology; a machine without NUMA is one node of every CPU.
+void read_topology (struct topology*);
+// Pin the calling thread to the CPUs of the given node.  Return 0 on success.
+int pin_to_node (struct topology*, int);
+// Return the node of the CPU the calling thread is running on.
+int current_node (struct topology*);
+// Start counting the calling thread's TLB and NUMA behaviour, and read the counts.
+void start_memcounters (struct memcounters*);
+void stop_memcounters (struct memcounters*, struct memcounts*);
+// Fold one set of counts into another.
+void add_memcounts (struct memcounts*, struct memcounts*);
+
+
+#endif
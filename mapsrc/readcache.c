@@ -0,0 +1,176 @@
+#include "readcache.h"
+
+
+// ============================================================================
+// readcache.c implements the duplicate-read cache.  Each shard is a
+// set-associative table: a read may only occupy the CACHE_WAYS slots of one
+// set, which keeps lookups to a few string comparisons and the cache's size
+// fixed.  A full set gives up its least recently used slot.
+// ============================================================================
+
+
+unsigned long hash_read (char *read, char strand)
+// Hash a read and its orientation (64-bit FNV-1a).
+{
+	unsigned long h = 0xcbf29ce484222325UL;
+	for (; *read; ++read) {
+		h = (h ^ (unsigned char) *read) * 0x100000001b3UL;
+	}
+	return (h ^ (unsigned char) strand) * 0x100000001b3UL;
+}
+
+
+struct cacheslot *find_set (struct readcache *cache, unsigned long hash, struct cacheshard **shard)
+// Return the first slot of the set a hash maps to, and the shard holding it.
+{
+	*shard = &cache -> shards[hash % CACHE_SHARDS];
+	return &(*shard) -> slots[(hash / CACHE_SHARDS) % (cache -> slots / CACHE_WAYS) * CACHE_WAYS];
+}
+
+
+void touch_slot (struct cacheslot *set, int way)
+// Mark one slot of a set as its most recently used.
+{
+	int w;
+	for (w = 0; w < CACHE_WAYS; ++w) {
+		set[w].recent = (w == way);
+	}
+}
+
+
+struct readcache *new_readcache (int entries)
+// Allocate a cache holding up to the given number of reads, spread evenly
+// over the shards.
+{
+	struct readcache *cache;
+	int s, sets;
+
+	cache = (struct readcache*) calloc (1, sizeof (struct readcache));
+	if (!cache) {
+		perror ("Unable to allocate read cache");
+		exit (1);
+	}
+	sets = (entries + CACHE_SHARDS * CACHE_WAYS - 1) / (CACHE_SHARDS * CACHE_WAYS);
+	cache -> slots = ((sets > 0)? sets : 1) * CACHE_WAYS;
+	for (s = 0; s < CACHE_SHARDS; ++s) {
+		pthread_mutex_init (&cache -> shards[s].lock, NULL);
+		cache -> shards[s].slots = (struct cacheslot*) calloc (cache -> slots, sizeof (struct cacheslot));
+		if (!cache -> shards[s].slots) {
+			perror ("Unable to allocate read cache");
+			exit (1);
+		}
+	}
+	return cache;
+}
+
+
+void free_readcache (struct readcache *cache)
+// Release a cache and the reads it holds.
+{
+	int s, k;
+	if (!cache) return;
+	for (s = 0; s < CACHE_SHARDS; ++s) {
+		for (k = 0; k < cache -> slots; ++k) {
+			free (cache -> shards[s].slots[k].read);
+		}
+		free (cache -> shards[s].slots);
+		pthread_mutex_destroy (&cache -> shards[s].lock);
+	}
+	free (cache);
+}
+
+
+int cache_lookup (struct readcache *cache, char *read, char strand, struct cachedhit *hit)
+// Look up a read in the given orientation.  Return 1 and copy out its
+// result if it is cached, 0 if not.
+{
+	unsigned long hash = hash_read (read, strand);
+	struct cacheshard *shard;
+	struct cacheslot *set = find_set (cache, hash, &shard), *slot;
+	int w, found = 0;
+
+	pthread_mutex_lock (&shard -> lock);
+	++shard -> lookups;
+	for (w = 0; w < CACHE_WAYS && !found; ++w) {
+		slot = &set[w];
+		if (slot -> read && slot -> hash == hash && slot -> strand == strand
+				&& strcmp (slot -> read, read) == 0) {
+			*hit = slot -> hit;
+			touch_slot (set, w);
+			++shard -> hits;
+			found = 1;
+		}
+	}
+	pthread_mutex_unlock (&shard -> lock);
+	return found;
+}
+
+
+void cache_store (struct readcache *cache, char *read, char strand, struct cachedhit *hit)
+// Store the result of mapping a read in the given orientation, in an empty
+// slot of its set if there is one, else in place of the least recently used
+// read.  A read already cached (stored meanwhile by another thread) is left.
+{
+	unsigned long hash = hash_read (read, strand);
+	struct cacheshard *shard;
+	struct cacheslot *set = find_set (cache, hash, &shard), *slot;
+	char *copy, *old = NULL;
+	long len = strlen (read) + 1;
+	int w, way = -1;
+
+	// Copy the read outside the lock.
+	copy = (char*) malloc (len);
+	if (!copy) {
+		perror ("Unable to allocate read cache entry");
+		exit (1);
+	}
+	memcpy (copy, read, len);
+
+	pthread_mutex_lock (&shard -> lock);
+	for (w = 0; w < CACHE_WAYS; ++w) {
+		slot = &set[w];
+		if (slot -> read && slot -> hash == hash && slot -> strand == strand
+				&& strcmp (slot -> read, read) == 0) {
+			way = -2;
+			break;
+		}
+		if (!slot -> read) {
+			way = w;
+		} else if (way < 0 && !slot -> recent) {
+			way = w;
+		}
+	}
+	if (way == -1) way = 0;
+	if (way >= 0) {
+		slot = &set[way];
+		old = slot -> read;
+		if (old) shard -> bytes -= strlen (old) + 1;
+		slot -> read = copy;
+		slot -> hash = hash;
+		slot -> strand = strand;
+		slot -> hit = *hit;
+		touch_slot (set, way);
+		shard -> bytes += len;
+		copy = NULL;
+	}
+	pthread_mutex_unlock (&shard -> lock);
+	free (old);
+	free (copy);
+}
+
+
+void cache_totals (struct readcache *cache, long *lookups, long *hits, long *bytes)
+// Sum the lookups, hits, and bytes allocated over every shard.  The bytes
+// include the slot tables as well as the reads.
+{
+	int s;
+	*lookups = *hits = 0;
+	*bytes = sizeof (struct readcache);
+	for (s = 0; s < CACHE_SHARDS; ++s) {
+		pthread_mutex_lock (&cache -> shards[s].lock);
+		*lookups += cache -> shards[s].lookups;
+		*hits += cache -> shards[s].hits;
+		*bytes += cache -> shards[s].bytes + (long) cache -> slots * sizeof (struct cacheslot);
+		pthread_mutex_unlock (&cache -> shards[s].lock);
+	}
+}
@@ -0,0 +1,74 @@
+#ifndef READCACHE_H_
+#define READCACHE_H_
+
+
+// ============================================================================
+// readcache.h declares the duplicate-read cache: a bounded table of mapping
+// results keyed on a read's sequence and orientation, so that byte-identical
+// reads are only seeded and aligned once.  A cache may be shared by any
+// number of mapping threads.
+// ============================================================================
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "../sfxsrc/suffix.h"
+
+
+// The table is split into shards, each with its own lock, so that threads
+// mapping different reads rarely wait on one another.
+
+#define CACHE_SHARDS		64
+#define CACHE_WAYS			2		// Slots a read may occupy within its shard.
+#define DEFAULT_CACHE_ENTRIES	65536
+
+
+// Mapping result kept for one read.
+struct cachedhit {
+	int contig;				// Contig of the hit, -1 if the read did not map.
+	pos_t start;			// First position of the alignment within the contig.
+	pos_t end;				// Last+1 position of the alignment within the contig.
+	double identity;		// Identity percentage of the hit.
+	double coverage;		// Percent of the read covered by the hit.
+};
+
+// One slot of a shard.  Slots are grouped into sets of CACHE_WAYS, and a
+// read may only occupy the slots of the set its hash picks.
+struct cacheslot {
+	unsigned long hash;		// Hash of the read and orientation.
+	char *read;				// Copy of the read, NULL if the slot is empty.
+	char strand;			// Orientation the read was mapped in.
+	char recent;			// 1 if the slot was used more recently than the rest of its set.
+	struct cachedhit hit;	// Result of mapping it.
+};
+
+struct cacheshard {
+	pthread_mutex_t lock;
+	struct cacheslot *slots;
+	long lookups;			// Lookups made against the shard.
+	long hits;				// Lookups answered from it.
+	long bytes;				// Bytes held by the reads stored in it.
+};
+
+struct readcache {
+	struct cacheshard shards[CACHE_SHARDS];
+	int slots;				// Slots per shard, a multiple of CACHE_WAYS.
+};
+
+
+// Interface Prototypes ===========
+
+// Allocate a cache holding up to the given number of reads.
+struct readcache *new_readcache (int);
+void free_readcache (struct readcache*);
+// Look up a read in the given orientation.  Return 1 and fill in the result if found.
+int cache_lookup (struct readcache*, char*, char, struct cachedhit*);
+// Store the result of mapping a read in the given orientation.
+void cache_store (struct readcache*, char*, char, struct cachedhit*);
+// Total lookups, hits, and bytes allocated, across all shards.
+void cache_totals (struct readcache*, long*, long*, long*);
+
+
+#endif
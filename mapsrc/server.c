@@ -0,0 +1,363 @@
+#include "server.h"
+
+
+// ============================================================================
+// server.c implements the mapping server and its client.  The server pays for
+// reading, building, and preparing the index once; each job afterwards only
+// pays for mapping its own reads.  Jobs run on their own threads against the
+// shared, read-only index.
+// ============================================================================
+
+
+double elapsed_ms (struct timeval *start, struct timeval *end)
+// Return the time elapsed between start and end in milliseconds.
+{
+	double elapsed;
+	elapsed = (end -> tv_sec - start -> tv_sec) * 1000.0;      // sec to ms
+	elapsed += (end -> tv_usec - start -> tv_usec) / 1000.0;   // us to ms
+	return elapsed;
+}
+
+
+int open_socket (const char *socketpath, struct sockaddr_un *addr)
+// Create a Unix domain socket and fill in the address for the given path.
+{
+	int fd;
+	if (strlen (socketpath) >= sizeof (addr -> sun_path)) {
+		printf ("Socket path %s is too long.\n", socketpath);
+		exit (1);
+	}
+	if ((fd = socket (AF_UNIX, SOCK_STREAM, 0)) < 0) {
+		perror ("Unable to create socket");
+		exit (1);
+	}
+	bzero (addr, sizeof (struct sockaddr_un));
+	addr -> sun_family = AF_UNIX;
+	strcpy (addr -> sun_path, socketpath);
+	return fd;
+}
+
+
+// ============================================================================
+// Server
+// ============================================================================
+
+
+void finish_job (struct job *job)
+// Release a job and signal the server if it was the last one running.
+{
+	struct server *server = job -> server;
+	pthread_mutex_lock (&server -> lock);
+	if (--server -> active == 0) {
+		pthread_cond_signal (&server -> idle);
+	}
+	pthread_mutex_unlock (&server -> lock);
+	free (job);
+}
+
+
+void *run_job (void *arg)
+// Read one command from the job's connection and carry it out.
+{
+	struct job *job = (struct job*) arg;
+	struct server *server = job -> server;
+	char cmd[CMD_LENGTH], verb[16], arg1[PATH_MAX], arg2[PATH_MAX];
+	struct timeval start, end;
+	struct mapindex *index = server -> index;
+	struct mapstats stats;
+	FILE *rfp, *wfp, *in, *out;
+	double elapsed;
+	int nargs;
+
+	rfp = fdopen (job -> fd, "r");
+	wfp = fdopen (dup (job -> fd), "w");
+	if (!rfp || !wfp) {
+		perror ("Unable to open connection");
+		if (rfp) fclose (rfp); else close (job -> fd);
+		finish_job (job);
+		return NULL;
+	}
+
+	bzero (cmd, CMD_LENGTH);
+	arg1[0] = arg2[0] = 0;
+	nargs = (fgets (cmd, CMD_LENGTH, rfp))?
+			sscanf (cmd, "%15s %4095s %4095s", verb, arg1, arg2) : 0;
+	gettimeofday (&start, NULL);
+
+	in = out = NULL;
+	if (nargs >= 2 && strcmp (verb, "MAP") == 0) {
+		if (!(in = open_reads (arg1))) {
+			fprintf (wfp, "ERR cannot open %s\n", arg1);
+		} else if (nargs == 3 && !(out = fopen (arg2, "w"))) {
+			fprintf (wfp, "ERR cannot open %s\n", arg2);
+		} else if (nargs == 2) {
+			out = wfp;
+		}
+	} else if (nargs >= 1 && strcmp (verb, "READS") == 0) {
+		in = rfp;
+		if (nargs == 2 && !(out = fopen (arg1, "w"))) {
+			fprintf (wfp, "ERR cannot open %s\n", arg1);
+		} else if (nargs == 1) {
+			out = wfp;
+		}
+	} else if (nargs >= 1 && strcmp (verb, "QUIT") == 0) {
+		pthread_mutex_lock (&server -> lock);
+		server -> stopping = 1;
+		pthread_mutex_unlock (&server -> lock);
+		shutdown (server -> listenfd, SHUT_RDWR);
+		fprintf (wfp, "# stopping\n");
+	} else {
+		fprintf (wfp, "ERR unknown command\n");
+	}
+
+	if (in && out) {
+		// Spread jobs over the NUMA nodes, each mapping against its own node's replica.
+		if (index -> replicas) {
+			index = index -> replicas[job -> id % index -> topo -> numnodes];
+			pin_to_node (index -> topo, index -> node);
+		}
+		map_read_file (index, in, out, &stats, NULL);
+		gettimeofday (&end, NULL);
+		elapsed = elapsed_ms (&start, &end);
+
+		// Report the job's latency and throughput to the client and the log.
+		fprintf (wfp, "# reads %d hits %d misses %d elapsed_ms %.3lf reads_per_sec %.1lf"
+				" read_p50_us %.1lf read_p99_us %.1lf read_max_us %.1lf cache_hits %d node %d",
+				stats.reads, stats.hits, stats.misses, elapsed,
+				(elapsed > 0.0)? stats.reads * 1000.0 / elapsed : 0.0,
+				hist_percentile (&stats.totallat, 50.0) / 1000.0,
+				hist_percentile (&stats.totallat, 99.0) / 1000.0, stats.totallat.max / 1000.0,
+				stats.cachehits, stats.node);
+		if (stats.memory.dtlbvalid) {
+			fprintf (wfp, " dtlb_miss_rate %.6lf", (stats.memory.dtlbloads > 0)?
+					(double) stats.memory.dtlbmisses / stats.memory.dtlbloads : 0.0);
+		}
+		if (stats.memory.nodevalid) {
+			fprintf (wfp, " remote_rate %.6lf", (stats.memory.nodeloads > 0)?
+					(double) stats.memory.nodemisses / stats.memory.nodeloads : 0.0);
+		}
+		fprintf (wfp, "\n");
+		printf ("Job %d: %d reads (%d hits) in %.3lf ms, %.1lf reads/s\n", job -> id,
+				stats.reads, stats.hits, elapsed,
+				(elapsed > 0.0)? stats.reads * 1000.0 / elapsed : 0.0);
+		fflush (stdout);
+	}
+	if (in && in != rfp) fclose (in);
+	if (out && out != wfp) fclose (out);
+	fclose (wfp);
+	fclose (rfp);
+	finish_job (job);
+	return NULL;
+}
+
+
+void serve_mapread (const char *socketpath, const char *genomefile, const char *alphabetfile,
+					struct mapopts *opts)
+// Build and prepare the index for the given genome once, placing and
+// replicating it as the options ask, then serve mapping jobs on the given
+// socket until a QUIT command arrives.
+{
+	char *alphabet, *genome, **names;
+	pos_t *starts;
+	int numcontigs, fd;
+	struct sockaddr_un addr;
+	struct timeval start, end;
+	struct server server;
+	struct job *job;
+	pthread_t thread;
+
+	// Build the index that every job will share.
+	gettimeofday (&start, NULL);
+	printf ("Building index for %s ....\n", genomefile);
+	read_alphabet (&alphabet, alphabetfile);
+	numcontigs = read_fasta_all (&names, &starts, &genome, alphabet, genomefile);
+	if (!numcontigs) {
+		printf ("No sequences found in %s.\n", genomefile);
+		exit (1);
+	}
+	bzero (&server, sizeof (struct server));
+	server.index = build_index (genome, names, starts, numcontigs, alphabet);
+	prepare_tree (server.index);
+	enable_cache (server.index, opts -> cacheentries);
+	if (opts -> pages >= 0) {
+		place_index (server.index, opts -> pages);
+		if (server.index -> placed) printf ("      >Index placed on %s pages\n", pages_name (server.index -> backing));
+	}
+	if (opts -> numa) {
+		printf ("      >Index replicated on %d NUMA node(s)\n", replicate_index (server.index,
+				(opts -> pages >= 0)? opts -> pages : PAGES_NORMAL));
+	}
+	gettimeofday (&end, NULL);
+	printf ("      >Elapsed time (Index): %lf ms\n", elapsed_ms (&start, &end));
+
+	// Listen for jobs.
+	server.listenfd = open_socket (socketpath, &addr);
+	unlink (socketpath);
+	if (bind (server.listenfd, (struct sockaddr*) &addr, sizeof (addr)) < 0
+			|| listen (server.listenfd, MAX_PENDING) < 0) {
+		perror ("Unable to listen on socket");
+		exit (1);
+	}
+	pthread_mutex_init (&server.lock, NULL);
+	pthread_cond_init (&server.idle, NULL);
+	signal (SIGPIPE, SIG_IGN);		// A client hanging up only ends its own job.
+	printf ("Serving on %s\n", socketpath);
+	fflush (stdout);
+
+	for (;;) {
+		fd = accept (server.listenfd, NULL, NULL);
+		pthread_mutex_lock (&server.lock);
+		if (server.stopping) {
+			pthread_mutex_unlock (&server.lock);
+			if (fd >= 0) close (fd);
+			break;
+		}
+		if (fd < 0) {
+			pthread_mutex_unlock (&server.lock);
+			perror ("Unable to accept connection");
+			continue;
+		}
+		job = (struct job*) malloc (sizeof (struct job));
+		if (!job) {
+			perror ("Unable to allocate job");
+			exit (1);
+		}
+		job -> server = &server;
+		job -> fd = fd;
+		job -> id = ++server.jobs;
+		++server.active;
+		pthread_mutex_unlock (&server.lock);
+
+		if (pthread_create (&thread, NULL, run_job, job)) {
+			perror ("Unable to start job");
+			close (fd);
+			finish_job (job);
+		} else {
+			pthread_detach (thread);
+		}
+	}
+
+	// Let jobs in progress finish before releasing the index.
+	pthread_mutex_lock (&server.lock);
+	while (server.active) {
+		pthread_cond_wait (&server.idle, &server.lock);
+	}
+	pthread_mutex_unlock (&server.lock);
+	printf ("Served %d jobs.\n", server.jobs);
+
+	close (server.listenfd);
+	unlink (socketpath);
+	free_index (server.index);
+	free (alphabet);
+}
+
+
+// ============================================================================
+// Client
+// ============================================================================
+
+
+int connect_server (const char *socketpath)
+// Connect to the server listening on the given socket.
+{
+	struct sockaddr_un addr;
+	int fd = open_socket (socketpath, &addr);
+	if (connect (fd, (struct sockaddr*) &addr, sizeof (addr)) < 0) {
+		perror ("Unable to connect to server");
+		exit (1);
+	}
+	return fd;
+}
+
+
+int absolute_path (char *abspath, const char *path)
+// Resolve path against the current directory, since the server's may differ.
+// Return 0 on success, -1 if the result would not fit in PATH_MAX.
+{
+	char cwd[PATH_MAX];
+	int n;
+	if (path[0] == '/' || !getcwd (cwd, PATH_MAX)) {
+		n = snprintf (abspath, PATH_MAX, "%s", path);
+	} else {
+		n = snprintf (abspath, PATH_MAX, "%s/%s", cwd, path);
+	}
+	return (n < 0 || n >= PATH_MAX)? -1 : 0;
+}
+
+
+int run_client (const char *socketpath, const char *readfile, const char *outfile)
+// Submit a mapping job to the server and copy its replies to stdout.  A read
+// file of "-" streams reads from stdin, inflated first if it is compressed.
+// Return 0 if the job succeeded.
+{
+	char cmd[CMD_LENGTH], path[PATH_MAX], outpath[PATH_MAX], buf[BUFSIZ];
+	struct pollfd fds[2];
+	int fd, in = -1, n, nfds, failed = 0;
+
+	if (outfile && absolute_path (outpath, outfile) < 0) {
+		fprintf (stderr, "Path too long: %s\n", outfile);
+		return 1;
+	}
+	if (strcmp (readfile, "-") != 0 && absolute_path (path, readfile) < 0) {
+		fprintf (stderr, "Path too long: %s\n", readfile);
+		return 1;
+	}
+	fd = connect_server (socketpath);
+	if (strcmp (readfile, "-") == 0) {
+		snprintf (cmd, CMD_LENGTH, "READS%s%s\n", (outfile)? " " : "", (outfile)? outpath : "");
+	} else {
+		snprintf (cmd, CMD_LENGTH, "MAP %s%s%s\n", path, (outfile)? " " : "", (outfile)? outpath : "");
+	}
+	signal (SIGPIPE, SIG_IGN);
+	if (write_all (fd, cmd, strlen (cmd)) < 0) {
+		perror ("Unable to send job");
+		exit (1);
+	}
+
+	// Copy stdin to the server while copying its replies to stdout.  Both
+	// directions are serviced together so neither side can stall the other.
+	nfds = 1;
+	if (strcmp (readfile, "-") != 0) {
+		shutdown (fd, SHUT_WR);
+	} else {
+		in = inflate_fd (STDIN_FILENO, 1);
+		nfds = 2;
+	}
+	fds[0].fd = fd; fds[0].events = POLLIN;
+	fds[1].fd = in; fds[1].events = POLLIN;
+	while (poll (fds, nfds, -1) > 0) {
+		if (nfds == 2 && fds[1].revents) {
+			n = read (in, buf, BUFSIZ);
+			if (n <= 0 || write_all (fd, buf, n) < 0) {
+				shutdown (fd, SHUT_WR);
+				nfds = 1;
+			}
+		}
+		if (fds[0].revents) {
+			if ((n = read (fd, buf, BUFSIZ)) <= 0) break;
+			if (strncmp (buf, "ERR", 3) == 0) failed = 1;
+			fwrite (buf, 1, n, stdout);
+		}
+	}
+	close (fd);
+	if (in >= 0) close (in);
+	return failed;
+}
+
+
+int stop_server (const char *socketpath)
+// Send the QUIT command to the server on the given socket.
+{
+	char buf[BUFSIZ];
+	int fd, n;
+	fd = connect_server (socketpath);
+	if (write_all (fd, "QUIT\n", 5) < 0) {
+		perror ("Unable to send job");
+		exit (1);
+	}
+	while ((n = read (fd, buf, BUFSIZ)) > 0) {
+		fwrite (buf, 1, n, stdout);
+	}
+	close (fd);
+	return 0;
+}
@@ -0,0 +1,67 @@
+#ifndef SERVER_H_
+#define SERVER_H_
+
+
+// ============================================================================
+// server.h declares the mapping server, which builds an index once and keeps
+// it resident while serving mapping jobs over a Unix domain socket, and the
+// client used to submit jobs to it.
+//
+// PROTOCOL: a client connects and sends one command line.
+//
+//     MAP <read file> [output file]     Map the reads in the named file.
+//     READS [output file]               Map the FASTA reads that follow the
+//                                       command, up to end of stream.
+//     QUIT                              Shut the server down.
+//
+// Results stream back over the socket in the same format as
+// MappingResults_*.txt, or are written to the output file when one is named.
+// Every job ends with a summary line beginning with '#', or a line beginning
+// with "ERR" if it could not be run.
+// ============================================================================
+
+
+#include <pthread.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <limits.h>
+#include "mapread.h"
+
+
+#define CMD_LENGTH		(2 * PATH_MAX + 16)
+#define MAX_PENDING		16
+
+
+// State shared by the server's job threads.
+struct server {
+	struct mapindex *index;		// Resident index every job maps against, or its replicas.
+	int listenfd;				// Listening socket.
+	int active;					// Number of jobs in progress.
+	int jobs;					// Number of jobs accepted so far.
+	int stopping;				// Set once a QUIT command has been received.
+	pthread_mutex_t lock;		// Guards active, jobs, and stopping.
+	pthread_cond_t idle;		// Signalled when active drops to zero.
+};
+
+// One accepted connection.
+struct job {
+	struct server *server;
+	int fd;						// Connected socket.
+	int id;						// Sequence number of the job.
+};
+
+
+// Interface Prototypes ===========
+
+// Build the index for the genome as the options ask and serve mapping jobs on the
+// socket until told to quit.
+void serve_mapread (const char*, const char*, const char*, struct mapopts*);
+// Submit a read file (or "-" for stdin) to a server, copying results to stdout.
+int run_client (const char*, const char*, const char*);
+// Ask the server on the given socket to shut down.
+int stop_server (const char*);
+
+
+#endif
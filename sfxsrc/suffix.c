@@ -3,19 +3,20 @@
 
 #include "suffix.h"
 
+
 // ============================================================================
 // suffix.c contains the implementation of McCreight's linear-time suffix tree 
 // building algorithm.  
 // ============================================================================
 
 
-void allocate_node (struct node **node, int sufnum, int starti, 
-					int endi, struct node *parent)
+void allocate_node (struct stree *st, struct node **node, pos_t sufnum, pos_t starti, 
+					pos_t endi, struct node *parent)
 // Allocate one node which marks the edge corresponding to the slice 
 // input_string[starti: endi].  
 {
-	*node = (struct node*) malloc (sizeof (struct node));
-	(*node) -> id = idCnt++;
+	*node = &st -> nodepool[st -> idCnt];
+	(*node) -> id = st -> idCnt++;
 	(*node) -> sfxnum = sufnum;
 	(*node) -> strdepth = parent -> strdepth + endi - starti;
 	(*node) -> starti = starti;
@@ -28,55 +29,64 @@ void allocate_node (struct node **node, int sufnum, int starti,
 	(*node) -> parent = parent;
 
 	// Check exact matching sequence length
-	if (!deepest) {
-		deepest = root;
-	} else if (sufnum == -1 && (*node) -> strdepth > deepest -> strdepth) {
-		deepest = (*node);
+	if (!st -> deepest) {
+		st -> deepest = st -> root;
+	} else if (sufnum == -1 && (*node) -> strdepth > st -> deepest -> strdepth) {
+		st -> deepest = (*node);
 	}
 }
 
 
-void init_root (int length)
+void init_root (struct stree *st, pos_t length)
 // Initialize the root node of the suffix tree.
 {
+	// Allocate the node pool.  A tree over n characters plus terminator never
+	// holds more than 2(n + 1) nodes, so the pool is sized once and node ids
+	// double as pool indices.  Pages are only touched as nodes are handed out.
+	st -> nodepool = (struct node*) malloc (sizeof (struct node) * MAX_NODES (length));
+	if (!st -> nodepool) {
+		perror ("Unable to allocate suffix tree");
+		exit (1);
+	}
+
 	// Give root node unique (no edge) attributes
-	root = (struct node*) malloc (sizeof(struct node));
-	root -> id = 0;
-	root -> sfxnum = -1;
-	root -> strdepth = 0;
-	root -> starti = -1;
-	root -> endi = -1;
+	st -> root = &st -> nodepool[0];
+	st -> root -> id = 0;
+	st -> root -> sfxnum = -1;
+	st -> root -> strdepth = 0;
+	st -> root -> starti = -1;
+	st -> root -> endi = -1;
 
 	// suffix link of root is itself.
-	root -> sfxlink = root;
+	st -> root -> sfxlink = st -> root;
 
 	// Initialize the first child of root with suffix corresponding to the
 	// entire input string.
-	allocate_node (&(root -> leftchild), 0, 0, length, root);
+	allocate_node (st, &(st -> root -> leftchild), 0, 0, length, st -> root);
 
 	// Root has no sibs or parent.
-	root -> rightsib = NULL;
-	root -> parent = NULL;
+	st -> root -> rightsib = NULL;
+	st -> root -> parent = NULL;
 }
 
 
-void prepare_str (char *s) 
+void prepare_str (struct stree *st, char *s) 
 // Prepare the string to be inserted into the tree.
 // Store its length and point input_string at it.
 {
-	input_string = s;
+	st -> input_string = s;
 	if (s[strlen(s) - 1] == '$') {	// User has already prepared string.
-		slen = strlen (s) - 1;
+		st -> slen = strlen (s) - 1;
 	} else {						// String has not yet been prepared.
-		slen = strlen (s);
-		input_string [slen] = '$';
-		input_string [slen + 1] = 0;
+		st -> slen = strlen (s);
+		st -> input_string [st -> slen] = '$';
+		st -> input_string [st -> slen + 1] = 0;
 	}
 
 }
 
 
-void print_string_slice (char *s, int start, int end)
+void print_string_slice (char *s, pos_t start, pos_t end)
 // Print the slice of string s[start:end]
 {
 	while (start < end) {
@@ -108,89 +118,153 @@ void print_children (struct node *node)
 {
 	struct node *child;
 	child = node -> leftchild;
-	printf ("Children of node %d\n", node -> id);
+	printf ("Children of node %ld\n", (long) node -> id);
 	while (child) {
-		printf ("ID: %d | Depth: %d | Interval: [%d, %d)\n", 
-			child -> id, child -> strdepth, child -> starti, child -> endi);
+		printf ("ID: %ld | Depth: %ld | Interval: [%ld, %ld)\n", (long) child -> id,
+			(long) child -> strdepth, (long) child -> starti, (long) child -> endi);
 		child = child -> rightsib;
 	}
 }
 
 
-void print_BWT (struct node *tree)
+void init_stack (struct dfs_stack *stack)
+// Initialize an empty traversal stack.
+{
+	stack -> size = 64;
+	stack -> top = 0;
+	stack -> nodes = (struct node**) malloc (sizeof (struct node*) * stack -> size);
+	if (!stack -> nodes) {
+		perror ("Unable to allocate traversal stack");
+		exit (1);
+	}
+}
+
+
+void push_stack (struct dfs_stack *stack, struct node *node)
+// Push a node onto the traversal stack, growing it as needed.
+{
+	if (stack -> top == stack -> size) {
+		stack -> size *= 2;
+		stack -> nodes = (struct node**) realloc (stack -> nodes, 
+							sizeof (struct node*) * stack -> size);
+		if (!stack -> nodes) {
+			perror ("Unable to grow traversal stack");
+			exit (1);
+		}
+	}
+	stack -> nodes[stack -> top++] = node;
+}
+
+
+void free_stack (struct dfs_stack *stack)
+// Release the memory held by a traversal stack.
+{
+	free (stack -> nodes);
+	stack -> nodes = NULL;
+	stack -> top = stack -> size = 0;
+}
+
+
+struct node *descend_left (struct dfs_stack *stack, struct node *node)
+// Follow leftmost children down from node, stacking each internal node passed.
+{
+	while (node -> leftchild) {
+		push_stack (stack, node);
+		node = node -> leftchild;
+	}
+	return node;
+}
+
+
+struct node *first_DFS (struct dfs_stack *stack, struct node *tree)
+// Begin a post-order (depth-first) traversal of the given tree and return
+// the first node visited.  The stack must be empty.
+{
+	return (tree)? descend_left (stack, tree) : NULL;
+}
+
+
+struct node *next_DFS (struct dfs_stack *stack, struct node *curr)
+// Return the node visited after curr in a post-order traversal begun with
+// first_DFS, or NULL once the traversal is complete.
+{
+	if (!stack -> top) {		// curr is the root of the traversal.
+		return NULL;
+	} else if (curr -> rightsib) {
+		return descend_left (stack, curr -> rightsib);
+	} else {
+		return stack -> nodes[--stack -> top];
+	}
+}
+
+
+void print_BWT (struct stree *st, struct node *tree)
 // Print the BWT index for the input string using the constructed tree.
 {
+	struct dfs_stack stack;
 	struct node *curr;
-	if (tree) {
-		curr = tree -> leftchild;
-		while (curr) {
-			print_BWT (curr);
-			curr = curr -> rightsib;
-		}
-		if (tree -> sfxnum != -1) {
+	init_stack (&stack);
+	for (curr = first_DFS (&stack, tree); curr; curr = next_DFS (&stack, curr)) {
+		if (curr -> sfxnum != -1) {
 			// BWT index is '$' if sfxnum == 0, else input_string[sfxnum - 1]
-			if (tree -> sfxnum == 0) {
+			if (curr -> sfxnum == 0) {
 				printf ("$\n");
 			} else {
-				printf ("%c\n", input_string[tree -> sfxnum - 1]);
+				printf ("%c\n", st -> input_string[curr -> sfxnum - 1]);
 			}
 		}
 	}
+	free_stack (&stack);
 }
 
 
 void print_DFS (struct node *tree)
 // Print string-depth info for depth-first traversal of the given suffix tree.
 {
+	struct dfs_stack stack;
 	struct node *curr;
-	if (tree) {
-		curr = tree -> leftchild;
-		while (curr) {
-			print_DFS (curr);
-			curr = curr -> rightsib;
-		}
-		printf ("%4d",tree -> strdepth);
+	init_stack (&stack);
+	for (curr = first_DFS (&stack, tree); curr; curr = next_DFS (&stack, curr)) {
+		printf ("%4ld", (long) curr -> strdepth);
 	}
+	free_stack (&stack);
 }
 
 
-void do_DFS (struct node *tree) 
+void do_DFS (struct stree *st, struct node *tree) 
 // Perform a depth-first traversal of the given suffix tree
-// and store the string depths of the nodes in the order visited.
+// and count the leaves and internal nodes visited.
 {
+	struct dfs_stack stack;
 	struct node *curr;
-	if (tree) {
-		curr = tree -> leftchild;
-		while (curr) {
-			do_DFS (curr);
-			curr = curr -> rightsib;
-		}
-		if (tree -> sfxnum == -1) {
-			++numints;
+	init_stack (&stack);
+	for (curr = first_DFS (&stack, tree); curr; curr = next_DFS (&stack, curr)) {
+		if (curr -> sfxnum == -1) {
+			++st -> numints;
 		} else {
-			++numleaves;
+			++st -> numleaves;
 		}
 	}
+	free_stack (&stack);
 }
 
 
-struct node *find_node (struct node *tree, int sufnum) 
+struct node *find_node (struct node *tree, pos_t sufnum) 
 // Locate the given node within the tree and return a pointer to it.
 {
-	struct node *curr, *ret;
-	if (!tree) {
-		return NULL;
-	} else if (tree -> sfxnum == sufnum) {
+	struct dfs_stack stack;
+	struct node *curr;
+	if (!tree || tree -> sfxnum == sufnum) {
 		return tree;
-	} else {
-		curr = tree -> leftchild;
-		while (curr != NULL) {
-			if (ret = find_node (curr, sufnum))
-				return ret;
-			curr = curr -> rightsib;
+	}
+	init_stack (&stack);
+	for (curr = first_DFS (&stack, tree); curr; curr = next_DFS (&stack, curr)) {
+		if (curr -> sfxnum == sufnum) {
+			break;
 		}
-		return NULL;
 	}
+	free_stack (&stack);
+	return curr;
 }
 
 
@@ -202,13 +276,13 @@ void push_node (struct node **list, struct node *node)
 }
 
 
-void sorted_insert (struct node **list, struct node *node)
+void sorted_insert (struct stree *st, struct node **list, struct node *node)
 // Insert the given node into the given list in alphabetical order according
 // to input_string[node -> starti].
 {
 	struct node **curr = list;
-	if (!(input_string[node -> starti] == '$')) {	// put $ at the start of list
-		while (*curr && input_string[(*curr) -> starti] < input_string[node -> starti]) {
+	if (!(st -> input_string[node -> starti] == '$')) {	// put $ at the start of list
+		while (*curr && st -> input_string[(*curr) -> starti] < st -> input_string[node -> starti]) {
 			curr = &((*curr) -> rightsib);
 		}
 	}
@@ -216,10 +290,10 @@ void sorted_insert (struct node **list, struct node *node)
 }
 
 
-void push_branch (struct node **tree, struct node *new_child)
+void push_branch (struct stree *st, struct node **tree, struct node *new_child)
 // Push the given new child to create a new branch off the given tree.
 {
-	sorted_insert (&((*tree) -> leftchild), new_child);
+	sorted_insert (st, &((*tree) -> leftchild), new_child);
 }
 
 
@@ -254,7 +328,7 @@ struct node *remove_child (struct node **list, struct node *child)
 }
 
 
-int identify_instype (struct node *u)
+int identify_instype (struct stree *st, struct node *u)
 // Identify the insertion type for the parent u of the last inserted leaf.
 // 		IA: suffix link of u is known and u is not root.
 // 		IB: suffix link of u is known and u is root.
@@ -262,20 +336,20 @@ int identify_instype (struct node *u)
 // 		IIB: suffix link of u is unknown and u's parent is root.
 {
 	if (u -> sfxlink) {
-		return (u == root)? IB : IA;
+		return (u == st -> root)? IB : IA;
 	} else {
-		return (u -> parent == root)? IIB : IIA;
+		return (u -> parent == st -> root)? IIB : IIA;
 	}
 }
 
 
-struct node *get_branch_by_match (char c, struct node *parent)
+struct node *get_branch_by_match (struct stree *st, char c, struct node *parent)
 // Search the children of the given parent node for the child whose label
 // begins with the given character c.  Return it when found, NULL if not found.
 {
-	struct node *branch = parent -> leftchild;
+	struct node *branch = first_child (st, parent);
 	while (branch) {
-		if (c == input_string[branch -> starti]) {
+		if (c == st -> input_string[branch -> starti]) {
 			break;
 		}
 		branch = branch -> rightsib;
@@ -284,13 +358,29 @@ struct node *get_branch_by_match (char c, struct node *parent)
 }
 
 
-struct node *get_branch (int matchindex, struct node *parent)
+struct node *get_branch_count (struct stree *st, char c, struct node *parent, long *compared)
+// As get_branch_by_match, additionally adding the number of child edges
+// compared against c to *compared.
+{
+	struct node *branch = first_child (st, parent);
+	while (branch) {
+		++*compared;
+		if (c == st -> input_string[branch -> starti]) {
+			break;
+		}
+		branch = branch -> rightsib;
+	}
+	return branch;
+}
+
+
+struct node *get_branch (struct stree *st, pos_t matchindex, struct node *parent)
 // Search the children of the given parent node for the child whose label
 // begins with input_string[matchindex].  Return it when found, NULL if not found.
 {
 	struct node *branch = parent -> leftchild;
 	while (branch) {
-		if (input_string[matchindex] == input_string[branch -> starti]) 
+		if (st -> input_string[matchindex] == st -> input_string[branch -> starti]) 
 			break;
 		branch = branch -> rightsib;
 	}
@@ -298,41 +388,41 @@ struct node *get_branch (int matchindex, struct node *parent)
 }
 
 
-struct node *break_edge (int breakindex, struct node *breaknode)
+struct node *break_edge (struct stree *st, pos_t breakindex, struct node *breaknode)
 // Break an edge by inserting a new node labelled with the first portion of the broken edge,
 // Push the rest of the edge label as a child branch of the new node.
 // Return a reference to the new internal node.
 {
 	struct node *newint;
-	allocate_node (&newint, -1, breaknode -> starti, breakindex, breaknode -> parent);
+	allocate_node (st, &newint, -1, breaknode -> starti, breakindex, breaknode -> parent);
 	breaknode = remove_child (&(breaknode -> parent -> leftchild), breaknode);
 	breaknode -> parent = newint;
 	breaknode -> starti = newint -> endi;
-	push_branch (&newint, breaknode);
-	push_branch (&(newint -> parent), newint);
+	push_branch (st, &newint, breaknode);
+	push_branch (st, &(newint -> parent), newint);
 	return newint;
 }
 
 
-struct node *find_path (int index, int sufdepth, struct node *v)
+struct node *find_path (struct stree *st, pos_t index, pos_t sufdepth, struct node *v)
 // Find path to the insertion point for the suffix beginning at input_string[index].
 // Allocate and insert the node.
 {
-	int i, j, e;
+	pos_t i, j, e;
 	struct node *branch, *parent, *newint, *leaf, *tmp;
 	
 	// find child starting with input_string[sufdepth]
 	i = sufdepth;
 	parent = v;
-	branch = get_branch (i, v);
+	branch = get_branch (st, i, v);
 	if (branch) {
 		j = branch -> starti;
 		e = branch -> endi - branch -> starti;
 		// Look for the first mismatch in the current suffix and the path below v
-		while (input_string[i] == input_string[j]) {
+		while (st -> input_string[i] == st -> input_string[j]) {
 			if (!(--e)) {
 				parent = branch;
-				if ((branch = get_branch (++i, branch)) == NULL) break;
+				if ((branch = get_branch (st, ++i, branch)) == NULL) break;
 				j = branch -> starti;
 				e = branch -> endi - branch -> starti;
 			} else {
@@ -344,28 +434,28 @@ struct node *find_path (int index, int sufdepth, struct node *v)
 	// Allocate and insert a leaf at the branch point.
 	if (branch) {	// Fork branch by making new internal node
 		if (branch -> endi - branch -> starti > 1) {
-			newint = break_edge (j, branch);
-			allocate_node (&leaf, index, i, slen, newint);
-			push_branch (&newint, leaf);
+			newint = break_edge (st, j, branch);
+			allocate_node (st, &leaf, index, i, st -> slen, newint);
+			push_branch (st, &newint, leaf);
 		} else {
-			allocate_node (&leaf, index, i, slen, branch);
-			push_branch (&branch, leaf);
+			allocate_node (st, &leaf, index, i, st -> slen, branch);
+			push_branch (st, &branch, leaf);
 		}
 	} else {
-		allocate_node (&leaf, index, i, slen, parent);
-		push_branch (&parent, leaf);
+		allocate_node (st, &leaf, index, i, st -> slen, parent);
+		push_branch (st, &parent, leaf);
 	}
 	return leaf;
 }
 
 
-struct node *consume_beta (int index, int firsti, int betalen, 
+struct node *consume_beta (struct stree *st, pos_t index, pos_t firsti, pos_t betalen, 
 							struct node *startnode, struct node *u)
 // Consume Beta (slice of input string);
 // Establish suffix link of u to point to the spot at which Beta was consumed;
 // Find leaf insertion location and return a pointer to it.
 {
-	int e, r, depth;
+	pos_t e, r, depth;
 	struct node *branch, *leaf;
 
 	r = 0;
@@ -375,30 +465,30 @@ struct node *consume_beta (int index, int firsti, int betalen,
 		e = (branch -> endi) - (branch -> starti);
 		if (r + e > betalen) {	// Beta is consumed mid-edge.
 			// Break edge.  Assign the suffix link to the breakpoint and append leaf.
-			u -> sfxlink = break_edge (branch -> starti + (betalen - r), branch); 
-			allocate_node (&leaf, index, index + u -> sfxlink -> strdepth, slen, u -> sfxlink);
-			push_branch (&(u -> sfxlink), leaf);
+			u -> sfxlink = break_edge (st, branch -> starti + (betalen - r), branch); 
+			allocate_node (st, &leaf, index, index + u -> sfxlink -> strdepth, st -> slen, u -> sfxlink);
+			push_branch (st, &(u -> sfxlink), leaf);
 			break;
 		} else if (r + e == betalen) {	// Beta is consumed at an existing node
 			// Establish link and place the leaf by matching characters.
 			u -> sfxlink = branch;
 			depth = index - 1 + u -> strdepth;
-			leaf = find_path (index, depth, branch);
+			leaf = find_path (st, index, depth, branch);
 			break;
 		} else { 		// Hop to next node by adding its edge length to r.
 			r += e;		
-			branch = get_branch (firsti + r, branch);
+			branch = get_branch (st, firsti + r, branch);
 		}
 	}
 	return leaf;
 }
 
-struct node *find_link (int index, struct node *parent, 
-						struct node *child, int firsti, int lasti)
+struct node *find_link (struct stree *st, pos_t index, struct node *parent, 
+						struct node *child, pos_t firsti, pos_t lasti)
 // Find and establish the suffix link for the given child node, 
 // working downward from its parent's suffix link.
 {
-	int e, betalen, r, depth;
+	pos_t betalen;
 	struct node *vp, *branch, *leaf;
 
 	// Capture beta for later consumption
@@ -406,15 +496,15 @@ struct node *find_link (int index, struct node *parent,
 
 	// traverse parent's suffix link.
 	vp = parent -> sfxlink;
-	branch = get_branch (firsti, vp);  
+	branch = get_branch (st, firsti, vp);  
 
 	if (branch && betalen) {	// Beta not empty
 		// Consume Beta and Establish child -> sfxlink
-		leaf = consume_beta (index, firsti, betalen, branch, child);
+		leaf = consume_beta (st, index, firsti, betalen, branch, child);
 	} else {	
 		// Beta was empty or no branch exists for the letter at input[index]
 		child -> sfxlink = vp;
-		leaf = find_path (index, index, vp);
+		leaf = find_path (st, index, index, vp);
 	}
 	return leaf;
 }
@@ -423,66 +513,66 @@ struct node *find_link (int index, struct node *parent,
 
 // ---------------- Case Handlers ------------------------------
 
-struct node *handle_IA (int index, struct node **tree, struct node *u) 
+struct node *handle_IA (struct stree *st, pos_t index, struct node **tree, struct node *u) 
 // Handle the case in which the suffix link of node u is KNOWN, and u is not root.
 {
-	int imin1, k, depth;
+	pos_t imin1, k, depth;
 	struct node *v;
 	k = u -> strdepth;
 	imin1 = index - 1;
 	v = u -> sfxlink;
-	if (v == root) {
+	if (v == st -> root) {
 		depth = index;
 	} else {
 		depth = k + imin1;
 	}
 	// Find the path to the insertion point, insert, and return pointer to it.
-	return find_path (index, depth, v);
+	return find_path (st, index, depth, v);
 }
 
-struct node *handle_IB (int index, struct node **tree, struct node *u)
+struct node *handle_IB (struct stree *st, pos_t index, struct node **tree, struct node *u)
 // Handle the case in which the suffix link of node u is KNOWN, and u is root.
 {
 	// Find the path to the insertion point, insert, and return pointer to it.
-	return find_path (index, index, u);
+	return find_path (st, index, index, u);
 }
 
-struct node *handle_IIA (int index, struct node **tree, struct node *u)
+struct node *handle_IIA (struct stree *st, pos_t index, struct node **tree, struct node *u)
 // Handle the case in which the suffix link of node u is UNKNOWN, and u's parent is not root.
 {
 	struct node *up = u -> parent;
 	// B = input_string [u->starti : u->endi]
-	return find_link (index, up, u, u -> starti, u -> endi);
+	return find_link (st, index, up, u, u -> starti, u -> endi);
 
 }
 
-struct node *handle_IIB (int index, struct node **tree, struct node *u)
+struct node *handle_IIB (struct stree *st, pos_t index, struct node **tree, struct node *u)
 // Handle the case in which the suffix link of node u is UNKNOWN, and u's parent is root.
 {
 	struct node *up = u -> parent;
-	return find_link (index, up, u, u -> starti + 1, u -> endi);
+	return find_link (st, index, up, u, u -> starti + 1, u -> endi);
 }
 
 // =============================================================
 
 
-struct node* insert_suffix (int index, struct node *tree, struct node **lastleaf)
+struct node* insert_suffix (struct stree *st, pos_t index, struct node *tree, struct node **lastleaf)
 // insert a new node corresponding to the suffix which begins at the given index.
 {	
 	struct node *u;
 	int instype;
 
 	u = (*lastleaf) -> parent;
-	instype = identify_instype (u);
+	instype = identify_instype (st, u);
 	switch (instype) {
 		// Suffix Link of u is KNOWN and u is NOT root.
-		case IA: 	*lastleaf = handle_IA (index, &tree, u); break;
+		case IA: 	*lastleaf = handle_IA (st, index, &tree, u); break;
 		// Suffix Link of u is KNOWN and u is root.
-		case IB: 	*lastleaf = handle_IB (index, &tree, u); break;
+		case IB: 	*lastleaf = handle_IB (st, index, &tree, u); break;
 		// Suffix Link of u is UNKNOWN and u's parent is NOT root.
-		case IIA:	*lastleaf = handle_IIA (index, &tree, u); break;
+		case IIA:	*lastleaf = handle_IIA (st, index, &tree, u); break;
 		// Suffix Link of u is UNKNOWN and u's parent is root.
-		case IIB:	*lastleaf = handle_IIB (index, &tree, u); break;
+		case IIB:	*lastleaf = handle_IIB (st, index, &tree, u); break;
 		default: printf ("Something is rotten in the state of Denmark.\n"); break;
 	}
 
@@ -490,49 +580,267 @@ struct node* insert_suffix (int index, struct node *tree, struct node **lastleaf
 }
 
 
-struct node *build_tree (char *s, char *alphabet)
+struct stree *build_tree (char *s, char *alphabet)
 // Build a suffix tree for the given string over the given alphabet
-// using McCreight's Suffix Link algorithm.
+// using McCreight's Suffix Link algorithm.  Return a handle that owns
+// all of the tree's state.
 {
-	int index = 1;
+	pos_t index = 1;
 	struct node *lastleaf;
-	idCnt = 1;
+	struct stree *st;
+
+	st = (struct stree*) calloc (1, sizeof (struct stree));
+	if (!st) {
+		perror ("Unable to allocate suffix tree");
+		exit (1);
+	}
+	st -> idCnt = 1;
 	
-	prepare_str (s);
+	prepare_str (st, s);
 	if (s) {
-		init_root (slen);
-		if (slen > 0) {
-			lastleaf = root -> leftchild;
+		init_root (st, st -> slen);
+		if (st -> slen > 0) {
+			lastleaf = st -> root -> leftchild;
 			// Iterate over the input string s inserting each suffix into
 			// the tree pointed to by root.
 			while (s[index]) {
-				root = insert_suffix (index++, root, &lastleaf);
+				st -> root = insert_suffix (st, index++, st -> root, &lastleaf);
 			}
 		}
 	}
-	return root;
+	return st;
 }
 
 
-void free_tree (struct node *tree) 
-// Deallocate the memory allocated to the given tree structure
+struct node *rebase_node (struct stree *from, struct node *pool, struct node *node)
+// Return the node of pool at the same place as the given node of from's pool.
 {
-	struct node *tmp, *curr;
-	if (tree) {
-		curr = tree -> leftchild;
-		while (curr) {
-			tmp = curr;
-			curr = curr -> rightsib;
-			free_tree (tmp);
+	return (node)? pool + (node - from -> nodepool) : NULL;
+}
+
+
+void copy_tree (struct stree *to, struct stree *from, struct node *pool, char *input_string)
+// Make to a copy of the tree from whose nodes live in pool, which has room
+// for from's idCnt nodes, over input_string, a copy of from's input string.
+// Every node pointer is rebased into pool; from is left as it was.
+{
+	struct node *node;
+	pos_t k;
+
+	*to = *from;
+	memcpy (pool, from -> nodepool, sizeof (struct node) * from -> idCnt);
+	for (k = 0; k < from -> idCnt; ++k) {
+		node = &pool[k];
+		node -> sfxlink = rebase_node (from, pool, node -> sfxlink);
+		node -> leftchild = rebase_node (from, pool, node -> leftchild);
+		node -> rightsib = rebase_node (from, pool, node -> rightsib);
+		node -> parent = rebase_node (from, pool, node -> parent);
+	}
+	to -> root = rebase_node (from, pool, from -> root);
+	to -> deepest = rebase_node (from, pool, from -> deepest);
+	to -> nodepool = pool;
+	to -> input_string = input_string;
+}
+
+
+void free_tree (struct stree *st) 
+// Deallocate the memory allocated to the given tree.  All nodes live in
+// the node pool, so this is a single release rather than a walk over the tree.
+// The input string belongs to the caller and is not freed.
+{
+	int k;
+	if (st) {
+		if (st -> locks) {
+			for (k = 0; k < LAZY_LOCKS; ++k) pthread_mutex_destroy (&st -> locks[k]);
+			free (st -> locks);
 		}
-		free (tree);
+		free (st -> suffixes);
+		free (st -> nodepool);
+		free (st);
 	}
 }
 
 
+// ============================================================================
+// Lazy trees
+// ============================================================================
 
+// A lazy tree is built write-only top-down: its root starts out holding
+// every suffix, and a node is only expanded into its children the first
+// time a search asks for them, by partitioning the node's range of the
+// suffix array on the character that follows the node's path.  Children
+// are made in the order sorted_insert keeps siblings in, so a fully
+// expanded lazy tree has the shape and leaf order of one built by
+// McCreight's algorithm.  Lazy nodes have no suffix links.
+//
+// Searches may expand nodes concurrently.  A node's children are linked in
+// full before leftchild is published with a release store, so readers take
+// no lock; expanders take the mutex of the node's stripe and check again.
+// Expanding a node only reorders its own range of the suffix array, which
+// is shared only with its ancestors, already expanded, and descendants,
+// not yet made.
+
+#define LAZY_STACK		256		// Suffixes a node can be partitioned with without allocating.
+
+
+int lazy_key (struct stree *st, pos_t pos)
+// Bucket of the character at pos: the terminator first, then by character.
+{
+	return (pos >= st -> slen)? 0 : 1 + (unsigned char) st -> input_string[pos];
+}
 
 
+struct node *lazy_node (struct stree *st, struct node *parent, pos_t sufnum, pos_t starti,
+						pos_t endi, pos_t lo, pos_t hi)
+// Hand out a node of a lazy tree marking the edge input_string[starti: endi]
+// below parent and holding the suffixes in suffixes[lo: hi + 1].
+{
+	pos_t id = __atomic_fetch_add (&st -> idCnt, 1, __ATOMIC_RELAXED);
+	struct node *node = &st -> nodepool[id];
+
+	node -> id = id;
+	node -> sfxnum = sufnum;
+	node -> strdepth = parent -> strdepth + endi - starti;
+	node -> starti = starti;
+	node -> endi = endi;
+	node -> array_start = lo;
+	node -> array_end = hi;
+	node -> sfxlink = NULL;
+	node -> leftchild = NULL;
+	node -> rightsib = NULL;
+	node -> parent = parent;
+	__atomic_fetch_add ((sufnum == -1)? &st -> numints : &st -> numleaves, 1, __ATOMIC_RELAXED);
+	return node;
+}
 
 
+struct node *expand_node (struct stree *st, struct node *node)
+// Partition an unexpanded internal node's suffixes among its children by
+// counting sort, make the children, and publish them.  A child holding one
+// suffix is a leaf; the edge of any other runs on for as long as its
+// suffixes agree.  Return the first child.
+{
+	pos_t count[257], next[257], stack[LAZY_STACK], *sorted = stack, *sfx = st -> suffixes;
+	pos_t lo = node -> array_start, hi = node -> array_end, depth = node -> strdepth;
+	pos_t k, pos, len, end;
+	int b;
+	char c;
+	struct node *first = NULL, *last = NULL, *child;
+
+	memset (count, 0, sizeof (count));
+	for (k = lo; k <= hi; ++k) ++count[lazy_key (st, sfx[k] + depth)];
+	for (b = 0, pos = 0; b < 257; ++b) {
+		next[b] = pos;
+		pos += count[b];
+	}
+	if (hi - lo + 1 > LAZY_STACK && !(sorted = (pos_t*) malloc (sizeof (pos_t) * (hi - lo + 1)))) {
+		perror ("Unable to expand suffix tree");
+		exit (1);
+	}
+	for (k = lo; k <= hi; ++k) sorted[next[lazy_key (st, sfx[k] + depth)]++] = sfx[k];
+	memcpy (&sfx[lo], sorted, sizeof (pos_t) * (hi - lo + 1));
+	if (sorted != stack) free (sorted);
+
+	for (b = 0, pos = lo; b < 257; pos += count[b++]) {
+		if (!count[b]) continue;
+		if (count[b] == 1) {
+			child = lazy_node (st, node, sfx[pos], sfx[pos] + depth, st -> slen, pos, pos);
+		} else {
+			// Suffixes are unique under the terminator, so they part before the end.
+			end = pos + count[b];
+			for (len = 1; ; ++len) {
+				c = st -> input_string[sfx[pos] + depth + len];
+				for (k = pos + 1; k < end && st -> input_string[sfx[k] + depth + len] == c; ++k);
+				if (k < end) break;
+			}
+			child = lazy_node (st, node, -1, sfx[pos] + depth, sfx[pos] + depth + len, pos, end - 1);
+		}
+		if (last) {
+			last -> rightsib = child;
+		} else {
+			first = child;
+		}
+		last = child;
+	}
+	__atomic_store_n (&node -> leftchild, first, __ATOMIC_RELEASE);
+	return first;
+}
+
+
+struct node *first_child (struct stree *st, struct node *node)
+// Return the first child of a node, NULL for a leaf.  A lazy tree's internal
+// node is expanded the first time this is asked of it.
+{
+	struct node *child = __atomic_load_n (&node -> leftchild, __ATOMIC_ACQUIRE);
+	pthread_mutex_t *lock;
+
+	if (child || !st -> suffixes || node -> sfxnum != -1) return child;
+	lock = &st -> locks[node -> id % LAZY_LOCKS];
+	pthread_mutex_lock (lock);
+	if (!(child = node -> leftchild)) child = expand_node (st, node);
+	pthread_mutex_unlock (lock);
+	return child;
+}
+
+
+void expand_subtree (struct stree *st, struct node *node)
+// Expand every node below the given one, so that the order of its range of
+// suffixes is final and no expansion will move them again.  A tree built in
+// full needs nothing.
+{
+	struct dfs_stack stack;
+	struct node *child;
+
+	if (!st -> suffixes) return;
+	init_stack (&stack);
+	push_stack (&stack, node);
+	while (stack.top) {
+		node = stack.nodes[--stack.top];
+		for (child = first_child (st, node); child; child = child -> rightsib) {
+			if (child -> sfxnum == -1) push_stack (&stack, child);
+		}
+	}
+	free_stack (&stack);
+}
 
+
+struct stree *build_lazy_tree (char *s)
+// Create a lazy suffix tree over the given string: a root holding every
+// suffix and nothing below it.  The node pool is reserved as build_tree
+// reserves it, but its pages are only touched as nodes are expanded.
+{
+	struct stree *st;
+	pos_t k;
+
+	st = (struct stree*) calloc (1, sizeof (struct stree));
+	if (!st) {
+		perror ("Unable to allocate suffix tree");
+		exit (1);
+	}
+	prepare_str (st, s);
+	st -> nodepool = (struct node*) malloc (sizeof (struct node) * MAX_NODES (st -> slen));
+	st -> suffixes = (pos_t*) malloc (sizeof (pos_t) * (st -> slen + 1));
+	st -> locks = (pthread_mutex_t*) malloc (sizeof (pthread_mutex_t) * LAZY_LOCKS);
+	if (!st -> nodepool || !st -> suffixes || !st -> locks) {
+		perror ("Unable to allocate suffix tree");
+		exit (1);
+	}
+	for (k = 0; k <= st -> slen; ++k) st -> suffixes[k] = k;
+	for (k = 0; k < LAZY_LOCKS; ++k) pthread_mutex_init (&st -> locks[k], NULL);
+
+	st -> root = st -> deepest = &st -> nodepool[0];
+	st -> root -> id = 0;
+	st -> root -> sfxnum = -1;
+	st -> root -> strdepth = 0;
+	st -> root -> starti = -1;
+	st -> root -> endi = -1;
+	st -> root -> array_start = 0;
+	st -> root -> array_end = st -> slen;
+	st -> root -> sfxlink = st -> root;
+	st -> root -> leftchild = NULL;
+	st -> root -> rightsib = NULL;
+	st -> root -> parent = NULL;
+	st -> idCnt = 1;
+	st -> numints = 1;
+	return st;
+}
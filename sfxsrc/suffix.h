@@ -14,6 +14,8 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <limits.h>
+#include <pthread.h>
 
 
 // Insertion Types ===============
@@ -25,19 +27,41 @@
 
 // ===============================
 
+// Positions in the indexed string, string depths, and node ids and counts.
+// They are 32 bits wide unless built with LARGE_GENOME defined
+// (make LARGE_GENOME=1), which makes them 64 bits wide and each node 88
+// bytes instead of 64.
+#ifdef LARGE_GENOME
+typedef long pos_t;
+#define POS_MAX			LONG_MAX
+#else
+typedef int pos_t;
+#define POS_MAX			INT_MAX
+#endif
+
+// Upper bound on the number of nodes in a tree over a string of length n.
+#define MAX_NODES(n)	(2 * ((n) + 1))
+
+// Longest string, terminator included, whose MAX_NODES still fits a pos_t:
+// 2^30 - 2 characters in a default build.
+#define MAX_STRING_LENGTH	(POS_MAX / 2 - 1)
+
+// Mutexes a lazy tree's expansion is striped over, by node id.
+#define LAZY_LOCKS		64
+
 
 // Suffix tree node structure ====
 
 // Tree uses LEFT CHILD / RIGHT SIBLING structure
 
 struct node {
-	int id;			// Unique identifier
-	int sfxnum;		// Index number 
-	int strdepth;	// Path length in characters from root to this node.
-	int starti;		// First index in slice of input_string stored by this node
-	int endi;		// Last+1 index in slice of input_string stored by this node
-	int array_start;			// First index of leaf array range that marks this node's leaves.
-	int array_end;				// Last index of leaf array range that marks this node's leaves.
+	pos_t id;		// Unique identifier
+	pos_t sfxnum;	// Index number 
+	pos_t strdepth;	// Path length in characters from root to this node.
+	pos_t starti;	// First index in slice of input_string stored by this node
+	pos_t endi;		// Last+1 index in slice of input_string stored by this node
+	pos_t array_start;			// First index of leaf array range that marks this node's leaves.
+	pos_t array_end;			// Last index of leaf array range that marks this node's leaves.
 	struct node *sfxlink;		// Pointer to this node's suffix link
 	struct node *leftchild;		// Pointer to first child (sorted alphabetically)
 	struct node *rightsib;		// Pointer to next sibling (sorted alphabetically)
@@ -47,13 +71,36 @@ struct node {
 // ================================
 
 
-// Global Variables ===============
+// Explicit traversal stack =======
+
+// Traversals keep the path from their starting node in a heap-allocated stack
+// rather than recursing, so deep trees cannot exhaust the call stack.
+
+struct dfs_stack {
+	struct node **nodes;	// Internal nodes on the path to the current node.
+	int top;				// Number of nodes on the stack.
+	int size;				// Allocated capacity of nodes.
+};
+
+// ================================
+
+
+// Suffix tree handle =============
+
+// Everything belonging to one tree lives here, so any number of trees can
+// be resident (and searched concurrently) in a single process.
 
-struct node *root;	// Stores the Tree for a given session.
-struct node *deepest; 		// Stored for reporting the longest exact matching sequence.
-char *input_string;	// Stores one instance of the input string to be referenced by all nodes.
-int idCnt, slen;	// Unique ID counter, length of input string
-int numleaves, numints; 	// For counting leaves and internal nodes.
+struct stree {
+	struct node *root;			// Root of the tree.
+	struct node *deepest; 		// Stored for reporting the longest exact matching sequence.
+	struct node *nodepool;		// Pool from which every node is allocated; ids index it.
+	char *input_string;			// String referenced by all nodes.  Owned by the caller.
+	pos_t idCnt, slen;			// Unique ID counter, length of input string
+	pos_t numleaves, numints; 	// For counting leaves and internal nodes.
+	pos_t *suffixes;			// Lazy trees only: every suffix number, a node's in
+								// suffixes[array_start: array_end + 1].  NULL if built in full.
+	pthread_mutex_t *locks;		// Lazy trees only: LAZY_LOCKS mutexes guarding expansion.
+};
 
 // ================================
 
@@ -61,14 +108,39 @@ int numleaves, numints; 	// For counting leaves and internal nodes.
 // Interface Prototypes ===========
 
 // Build a suffix tree from the given string over the given alphabet.
-struct node *build_tree (char*, char*);
+struct stree *build_tree (char*, char*);
+// Create a lazy suffix tree over the given string, whose nodes are expanded the first
+// time a search reaches them.  Safe to search from several threads at once.
+struct stree *build_lazy_tree (char*);
+// Return a node's first child, expanding the node first in a lazy tree.
+struct node *first_child (struct stree*, struct node*);
+// Expand every node below the given one of a lazy tree, fixing the order of its suffixes.
+void expand_subtree (struct stree*, struct node*);
 // Search the children of the given parent node for the branch that matches given char.
-struct node *get_branch_by_match (char, struct node*);
+struct node *get_branch_by_match (struct stree*, char, struct node*);
+// As get_branch_by_match, also counting the child edges compared.
+struct node *get_branch_count (struct stree*, char, struct node*, long*);
+// Copy a tree into a caller-provided node pool and input string.
+void copy_tree (struct stree*, struct stree*, struct node*, char*);
 // Free the memory allocated to a suffix tree.
-void free_tree (struct node*);
+void free_tree (struct stree*);
 // Print the children of the given node.
 void print_children (struct node*);
 // Print a depth-first traversal of the given tree.
 void print_DFS (struct node*);
+// Print the BWT of the tree's input string.
+void print_BWT (struct stree*, struct node*);
+// Count the leaves and internal nodes of the given tree into numleaves, numints.
+void do_DFS (struct stree*, struct node*);
+// Locate the leaf for the given suffix number.
+struct node *find_node (struct node*, pos_t);
+// Initialize, grow, and release an explicit traversal stack.
+void init_stack (struct dfs_stack*);
+void push_stack (struct dfs_stack*, struct node*);
+void free_stack (struct dfs_stack*);
+// Begin a post-order traversal of the given tree; return the first node visited.
+struct node *first_DFS (struct dfs_stack*, struct node*);
+// Return the node visited after the given one in a post-order traversal.
+struct node *next_DFS (struct dfs_stack*, struct node*);
 
 #endif